@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include "ApproxStats.h"
+
+namespace {
+	//Leading zero bits of a 64bit value
+	int leadingZeros64(uint64_t value) {
+		if (value == 0) return 64;
+		int zeros = 0;
+		for (int shift = 32; shift > 0; shift >>= 1) {
+			if ((value >> (64 - shift)) == 0) { zeros += shift; value <<= shift; }
+		}
+		return zeros;
+	}
+
+	//Scaled count from a 1/rate sample, 95% binomial bound
+	double scaleBound(uint64_t sampled, uint32_t rate) {
+		double p = 1.0 / rate;
+		return Approx_Confidence_Z * rate * std::sqrt(std::max<double>((double)sampled, 1.0) * (1.0 - p));
+	}
+
+	ApproxStats::Estimate scaled(uint64_t sampled, uint32_t rate) {
+		return { (double)sampled * rate, scaleBound(sampled, rate) };
+	}
+
+	//Sample quantile of sorted values, bound from the 95% binomial rank interval around q*n
+	ApproxStats::Estimate sampleQuantile(const std::vector<uint64_t>& sorted, double q) {
+		ApproxStats::Estimate out;
+		if (sorted.empty()) { out.bounded = false; return out; }
+
+		double n = (double)sorted.size();
+		double spread = Approx_Confidence_Z * std::sqrt(n * q * (1.0 - q));
+		double lowRank = std::floor(n * q - spread);
+		double highRank = std::ceil(n * q + spread);
+		out.value = (double)sorted[(size_t)(q * (n - 1))];
+		out.bounded = lowRank >= 0.0 && highRank <= n - 1;
+
+		double low = (double)sorted[(size_t)std::max(lowRank, 0.0)];
+		double high = (double)sorted[(size_t)std::min(highRank, n - 1)];
+		out.bound = std::max(out.value - low, high - out.value);
+		return out;
+	}
+
+	void printEstimate(const char* label, const ApproxStats::Estimate& estimate, const char* unit = "") {
+		std::cout << std::left << std::setw(30) << label << (uint64_t)std::llround(estimate.value) << unit;
+		if (estimate.bounded) std::cout << " +/- " << (uint64_t)std::llround(estimate.bound) << unit << std::endl;
+		else std::cout << " (too few samples to bound)" << std::endl;
+	}
+
+	struct AdvantageSum {
+		uint64_t count = 0;
+		double sum = 0.0;
+		double sumSquares = 0.0;
+
+		void add(uint64_t value) { ++count; sum += (double)value; sumSquares += (double)value * value; }
+		ApproxStats::Estimate mean() const {
+			if (count < 2) return { count ? sum : 0.0, 0.0, false };
+			double variance = std::max(0.0, (sumSquares - sum * sum / count) / (count - 1));
+			return { sum / count, Approx_Confidence_Z * std::sqrt(variance / count) };
+		}
+	};
+}
+
+void HyperLogLog::add(uint64_t hash) {
+	size_t index = hash >> (64 - HLL_Precision);
+	uint64_t rest = hash << HLL_Precision;
+	uint8_t rank = (uint8_t)std::min(leadingZeros64(rest), 64 - HLL_Precision) + 1;
+	registers[index] = std::max(registers[index], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+	for (size_t i = 0; i < registers.size(); ++i) registers[i] = std::max(registers[i], other.registers[i]);
+}
+
+double HyperLogLog::estimate() const {
+	const double m = HLL_Registers;
+	double harmonic = 0.0;
+	size_t zeros = 0;
+	for (uint8_t reg : registers) {
+		harmonic += std::ldexp(1.0, -reg);
+		if (reg == 0) ++zeros;
+	}
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double estimate = alpha * m * m / harmonic;
+
+	//Small range correction, linear counting
+	if (estimate <= 2.5 * m && zeros != 0) estimate = m * std::log(m / zeros);
+	return estimate;
+}
+
+ApproxStats::ApproxStats(uint32_t sampleRate, size_t maxSampled)
+	: sampleRate(std::max<uint32_t>(sampleRate, 1)), initialSampleRate(this->sampleRate), maxSampled(std::max<size_t>(maxSampled, 1)) {
+	sampleLog.reserve(this->maxSampled + 1);
+}
+
+void ApproxStats::add(Stats::Side side, uint32_t seq, uint64_t ts_ns) {
+	uint64_t hash = SeqSample::hash(seq);
+	if (side == Stats::Side::A) { uniquesA.add(hash); ++totalA; }
+	else { uniquesB.add(hash); ++totalB; }
+
+	if (!SeqSample::isSampled(hash, sampleRate)) return;
+
+	SampleEntry& curEntry = sampleLog[seq];
+	uint64_t& curTs = (side == Stats::Side::A) ? curEntry.tsA : curEntry.tsB;
+	bool& curValid = (side == Stats::Side::A) ? curEntry.validA : curEntry.validB;
+	curTs = curValid ? std::min(curTs, ts_ns) : ts_ns;
+	curValid = true;
+
+	//Full, halve the sample: 1/2N seqs are a subset of the 1/N ones, evict the rest
+	while (sampleLog.size() > maxSampled && sampleRate <= UINT32_MAX / 2) {
+		sampleRate *= 2;
+		for (auto it = sampleLog.begin(); it != sampleLog.end();) {
+			if (SeqSample::isSampled(SeqSample::hash(it->first), sampleRate)) ++it;
+			else it = sampleLog.erase(it);
+		}
+	}
+}
+
+uint32_t ApproxStats::getSampleRate() const { return sampleRate; }
+
+ApproxStats::Summary ApproxStats::summarize() const {
+	uint64_t onlyA = 0, onlyB = 0, matched = 0, AFasterCount = 0, BFasterCount = 0, ties = 0;
+	AdvantageSum advA, advB;
+	std::vector<uint64_t> advantagesA, advantagesB;
+
+	for (auto& [seq, entry] : sampleLog) {
+		if (entry.validA && !entry.validB)
+			++onlyA;
+		else if (!entry.validA && entry.validB)
+			++onlyB;
+		else if (entry.validA && entry.validB) {
+			++matched;
+			if (entry.tsA < entry.tsB) {
+				++AFasterCount;
+				advA.add(entry.tsB - entry.tsA);
+				advantagesA.push_back(entry.tsB - entry.tsA);
+			}
+			else if (entry.tsB < entry.tsA) {
+				++BFasterCount;
+				advB.add(entry.tsA - entry.tsB);
+				advantagesB.push_back(entry.tsA - entry.tsB);
+			}
+			else
+				++ties;
+		}
+	}
+	std::sort(advantagesA.begin(), advantagesA.end());
+	std::sort(advantagesB.begin(), advantagesB.end());
+
+	HyperLogLog uniques = uniquesA;
+	uniques.merge(uniquesB);
+	const double hllBound = Approx_Confidence_Z * HyperLogLog::relativeError();
+
+	Summary sum;
+	sum.sampleRate = sampleRate;
+	sum.sampledSeqs = sampleLog.size();
+	sum.uniques = { uniques.estimate(), uniques.estimate() * hllBound };
+	sum.uniquesA = { uniquesA.estimate(), uniquesA.estimate() * hllBound };
+	sum.uniquesB = { uniquesB.estimate(), uniquesB.estimate() * hllBound };
+	sum.totalA = { (double)totalA, 0.0 };
+	sum.totalB = { (double)totalB, 0.0 };
+	sum.matched = scaled(matched, sampleRate);
+	sum.onlyA = scaled(onlyA, sampleRate);
+	sum.onlyB = scaled(onlyB, sampleRate);
+	sum.AFasterCount = scaled(AFasterCount, sampleRate);
+	sum.AFasterAdvAvg = advA.mean();
+	sum.AFasterAdvP50 = sampleQuantile(advantagesA, 0.50);
+	sum.AFasterAdvP99 = sampleQuantile(advantagesA, 0.99);
+	sum.BFasterCount = scaled(BFasterCount, sampleRate);
+	sum.BFasterAdvAvg = advB.mean();
+	sum.BFasterAdvP50 = sampleQuantile(advantagesB, 0.50);
+	sum.BFasterAdvP99 = sampleQuantile(advantagesB, 0.99);
+	sum.ties = scaled(ties, sampleRate);
+	return sum;
+}
+
+void ApproxStats::generateStats() const {
+	Summary sum = summarize();
+	//Sketches, sample log nodes and buckets, one advantage per sampled seq copied by summarize()
+	size_t memory = 2 * sizeof(HyperLogLog) + sampleLog.bucket_count() * sizeof(void*)
+		+ sampleLog.size() * (sizeof(std::pair<const uint32_t, SampleEntry>) + 2 * sizeof(void*) + sizeof(uint64_t));
+
+	std::cout << "===== Feed Summary (approximate, 95% bounds) =====\n";
+	std::cout << std::left << std::setw(30) << "Channels:" << "A = " << static_cast<uint16_t>(Stats::Side::A) << std::endl;
+	std::cout << std::left << std::setw(30) << "" << "B = " << static_cast<uint16_t>(Stats::Side::B) << std::endl;
+	std::cout << std::left << std::setw(30) << "Sample rate" << "1/" << sampleRate << " (" << sum.sampledSeqs << " seqs kept";
+	if (sampleRate != initialSampleRate) std::cout << ", raised from 1/" << initialSampleRate << " to stay under " << maxSampled;
+	std::cout << ")" << std::endl;
+	std::cout << std::left << std::setw(30) << "Approx memory" << (memory + 1023) / 1024 << " KB" << std::endl;
+
+	std::cout << std::endl;
+	printEstimate("Total unique seqs", sum.uniques);
+	printEstimate("Unique seqs in A", sum.uniquesA);
+	printEstimate("Unique seqs in B", sum.uniquesB);
+	printEstimate("Total packets from A", sum.totalA);
+	printEstimate("Total packets from B", sum.totalB);
+
+	std::cout << std::endl;
+	printEstimate("Matched seqs", sum.matched);
+	printEstimate("Only in A", sum.onlyA);
+	printEstimate("Only in B", sum.onlyB);
+
+	std::cout << std::endl;
+	printEstimate("A faster count", sum.AFasterCount);
+	printEstimate("A avg speed advantage", sum.AFasterAdvAvg, " ns");
+	printEstimate("A advantage p50", sum.AFasterAdvP50, " ns");
+	printEstimate("A advantage p99", sum.AFasterAdvP99, " ns");
+	printEstimate("B faster count", sum.BFasterCount);
+	printEstimate("B avg speed advantage", sum.BFasterAdvAvg, " ns");
+	printEstimate("B advantage p50", sum.BFasterAdvP50, " ns");
+	printEstimate("B advantage p99", sum.BFasterAdvP99, " ns");
+	printEstimate("Packets with same speed", sum.ties);
+}
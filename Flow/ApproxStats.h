@@ -0,0 +1,125 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include "SeqSample.h"
+#include "Stats.h"
+
+#define HLL_Precision 12
+#define HLL_Registers (1 << HLL_Precision)
+#define Approx_Default_Sample_Rate 1024
+#define Approx_Max_Sampled_Seqs 4096 //Sample log cap, sample rate doubles when it is reached
+#define Approx_Confidence_Z 1.96 //95% bounds
+
+/*
+HyperLogLog distinct counter
+-4KB of registers, standard error 1.04/sqrt(HLL_Registers) (~1.6%)
+*/
+class HyperLogLog {
+private:
+	std::array<uint8_t, HLL_Registers> registers{};
+
+public:
+	void add(uint64_t hash);
+	void merge(const HyperLogLog& other);
+	double estimate() const;
+	static double relativeError() { return 1.04 / std::sqrt((double)HLL_Registers); }
+};
+
+/*
+Approximate A/B arbitration summary in bounded memory
+-Unique seqs per feed and overall from HyperLogLog
+-Match/win counts and advantages from a deterministic 1/sampleRate seq-hash sample,
+ scaled back up, advantage quantiles taken straight from the sampled values
+-At most maxSampled seqs are kept: when the log is full the sample rate doubles and
+ seqs no longer in the 1/sampleRate sample are evicted (samples are nested, so the
+ result is the same as sampling at the final rate from the start)
+-Every printed number carries a 95% error bound, including the sampling error
+ of the quantiles (order statistic rank interval)
+
+Usage:
+-Call add(side, seq, ts_ns) for each parsed packet (ts_ns unused for non-sampled seqs)
+-Call generateStats() once at the end
+*/
+class ApproxStats {
+public:
+	//Estimate with its 95% bound, bounded false when there are too few samples to bound it
+	struct Estimate {
+		double value = 0.0;
+		double bound = 0.0;
+		bool bounded = true;
+	};
+
+	//Approximate counterpart of Stats::Summary, as printed by generateStats()
+	struct Summary {
+		uint32_t sampleRate = 1;
+		size_t sampledSeqs = 0;
+		Estimate uniques;
+		Estimate uniquesA;
+		Estimate uniquesB;
+		Estimate totalA;
+		Estimate totalB;
+		Estimate matched;
+		Estimate onlyA;
+		Estimate onlyB;
+		Estimate AFasterCount;
+		Estimate AFasterAdvAvg;
+		Estimate AFasterAdvP50;
+		Estimate AFasterAdvP99;
+		Estimate BFasterCount;
+		Estimate BFasterAdvAvg;
+		Estimate BFasterAdvP50;
+		Estimate BFasterAdvP99;
+		Estimate ties;
+	};
+
+private:
+	struct SampleEntry {
+		uint64_t tsA = 0;
+		uint64_t tsB = 0;
+		bool validA = false;
+		bool validB = false;
+	};
+
+	uint32_t sampleRate;
+	uint32_t initialSampleRate;
+	size_t maxSampled;
+	HyperLogLog uniquesA;
+	HyperLogLog uniquesB;
+	std::unordered_map<uint32_t, SampleEntry> sampleLog;
+	size_t totalA = 0;
+	size_t totalB = 0;
+
+public:
+	/*
+	Inputs:
+			sampleRate	-Keep exact state for 1 in sampleRate seqs, raised when the log is full
+			maxSampled	-Most seqs kept in the sample log
+	*/
+	ApproxStats(uint32_t sampleRate = Approx_Default_Sample_Rate, size_t maxSampled = Approx_Max_Sampled_Seqs);
+
+	/*
+	Ingest a packet
+	Inputs:
+			side	-Which feed this packet came from
+			seq	-MsgSeqNum
+			ts_ns	-timestamp (nanoseconds)
+	*/
+	void add(Stats::Side side, uint32_t seq, uint64_t ts_ns);
+
+	/*
+	Current sample rate, PacketParser::setSampleRate must follow it (never above it)
+	*/
+	uint32_t getSampleRate() const;
+
+	/*
+	Compute approximate A and B arbitration statistics with error bounds
+	*/
+	Summary summarize() const;
+
+	/*
+	Print approximate A and B arbitration statistics with error bounds
+	*/
+	void generateStats() const;
+};
@@ -0,0 +1,35 @@
+#include <cstdio>
+#include "PacketFilter.h"
+#include "Stats.h"
+
+PacketFilter::PacketFilter(std::initializer_list<uint16_t> dstPorts) : portList(dstPorts) {
+	for (uint16_t port : portList) ports.set(port);
+}
+
+PacketFilter PacketFilter::forSides() {
+	return PacketFilter({ (uint16_t)Stats::Side::A, (uint16_t)Stats::Side::B });
+}
+
+std::string PacketFilter::bpfExpression() const {
+	//Keep the channel ports, plus everything the decoder can walk into
+	auto match = [&](bool inner) {
+		std::string out;
+		auto append = [&](const std::string& term) { out += (out.empty() ? "" : " or ") + term; };
+		for (uint16_t port : portList) append("udp dst port " + std::to_string(port));
+		for (unsigned protocol = 0; protocol < 256; ++protocol) {
+			PacketParser::Layer layer = PacketParser::ipv4ProtocolLayer((uint8_t)protocol);
+			if (layer != PacketParser::Layer::Unsupported && layer != PacketParser::Layer::UDP) append("ip proto " + std::to_string(protocol));
+		}
+		for (uint32_t type = 0; type <= 0xFFFF; ++type) {
+			if (type == IPv4_type || PacketParser::etherTypeLayer((uint16_t)type) == PacketParser::Layer::Unsupported) continue;
+			if (type == Ethernet_VLAN_TPID_Value && !inner) continue; //Outer tag is the vlan clause below
+			char hex[8];
+			std::snprintf(hex, sizeof(hex), "0x%04x", type);
+			append(std::string("ether proto ") + hex);
+		}
+		return out;
+	};
+
+	//vlan shifts offsets for the rest of the expression, so it goes last
+	return "(" + match(false) + ") or (vlan and (" + match(true) + "))";
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include <pcap.h>
+#include "PacketParser.h"
+
+#define Filter_Ethernet_Header_Length 14
+#define Filter_VLAN_Tag_Length 4
+#define Filter_Min_Length (Filter_Ethernet_Header_Length + Filter_VLAN_Tag_Length + IPv4_Min_Header_Length + UDP_Src_Length + UDP_Dst_Length)
+
+/*
+Pre-parse filter compiled from the channel dst port set
+-Offline: fixed-offset byte checks run ahead of the PacketParser layer walk,
+ frames that can never reach Stats (other ports, TCP, ARP, ...) are dropped there
+-Only untagged/single VLAN IPv4 is decided here, anything encapsulated
+ (QinQ, MPLS, GRE, IPv6, ...) passes through to the full decoder
+-Live: same rules rendered as a BPF expression for PcapHandler::setFilter
+*/
+class PacketFilter {
+private:
+	std::bitset<65536> ports;
+	std::vector<uint16_t> portList;
+
+	static uint16_t readBigEndian16(const uint8_t* ptr) { return (uint16_t)((uint16_t)ptr[0] << 8 | (uint16_t)ptr[1]); }
+
+public:
+	/*
+	Inputs:
+			dstPorts	-UDP destination ports to keep
+	*/
+	PacketFilter(std::initializer_list<uint16_t> dstPorts);
+
+	//Stats::Side A/B ports
+	static PacketFilter forSides();
+
+	/*
+	Cheap accept/reject of a raw frame
+	Inputs:
+			header		-Packet header from PcapHandler
+			pkt_data	-Packet data from PcapHandler
+	Outputs:
+			true/false	-False if the frame can't be an A/B packet, true if it might be
+	*/
+	bool accept(const pcap_pkthdr* header, const u_char* pkt_data) const {
+		//Too short to judge, the parser counts it as truncated
+		if (header->caplen < Filter_Min_Length) return true;
+
+		uint16_t type = readBigEndian16(pkt_data + Ethernet_Dst_Length + Ethernet_Src_Length);
+		size_t l3 = Filter_Ethernet_Header_Length;
+		if (type == Ethernet_VLAN_TPID_Value) {
+			type = readBigEndian16(pkt_data + Filter_Ethernet_Header_Length + Ethernet_VLAN_TCI_Length);
+			l3 += Filter_VLAN_Tag_Length;
+		}
+		if (type != IPv4_type) return PacketParser::etherTypeLayer(type) != PacketParser::Layer::Unsupported;
+
+		const uint8_t* ip = pkt_data + l3;
+		uint8_t protocol = ip[IPv4_Protocol_Offset];
+		if (protocol != IPPROTO_UDP_Value) return PacketParser::ipv4ProtocolLayer(protocol) != PacketParser::Layer::Unsupported;
+
+		size_t l4 = l3 + (ip[0] & 0x0F) * IpV4_IHL_Header_Size / 8;
+		if ((ip[0] >> 4) != 4 || header->caplen < l4 + UDP_Src_Length + UDP_Dst_Length) return true; //Malformed, parser decides
+		return ports[readBigEndian16(pkt_data + l4 + UDP_Src_Length)];
+	}
+
+	/*
+	Same rules as accept() as a libpcap filter expression
+	Outputs:
+			string	-BPF expression for pcap_compile
+	*/
+	std::string bpfExpression() const;
+};
@@ -1,6 +1,9 @@
+#include <array>
 #include <cstring>
 #include <iostream>
+#include <iomanip>
 #include "PacketParser.h"
+#include "PacketFilter.h"
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -8,79 +11,270 @@
 #include <arpa/inet.h>
 #endif
 
+namespace {
+	using Layer = PacketParser::Layer;
+
+	struct EtherTypeEntry {
+		uint16_t type;
+		Layer layer;
+	};
+
+	//EtherTypes (and GRE protocol types) the decoder walks through
+	constexpr EtherTypeEntry etherTypes[] = {
+		{ IPv4_type, Layer::IPv4 },
+		{ IPv6_type, Layer::IPv6 },
+		{ Ethernet_VLAN_TPID_Value, Layer::VLAN },
+		{ Ethernet_QinQ_TPID_Value, Layer::VLAN },
+		{ Ethernet_QinQ_Legacy_TPID_Value, Layer::VLAN },
+		{ MPLS_Unicast_type, Layer::MPLS },
+		{ MPLS_Multicast_type, Layer::MPLS },
+		{ ERSPAN2_type, Layer::ERSPAN2 },
+		{ ERSPAN3_type, Layer::ERSPAN3 },
+		{ TransparentEthernet_type, Layer::Ethernet },
+	};
+
+	//Fold 16bit EtherType into a 256 slot table, collision free for the types above
+	constexpr size_t foldEtherType(uint16_t type) { return (type ^ (type >> 8)) & 0xFF; }
+
+	constexpr std::array<EtherTypeEntry, 256> makeEtherTypeTable() {
+		std::array<EtherTypeEntry, 256> table{};
+		for (auto& entry : table) entry = { 0, Layer::Unsupported };
+		for (const auto& entry : etherTypes) table[foldEtherType(entry.type)] = entry;
+		return table;
+	}
+	constexpr std::array<EtherTypeEntry, 256> etherTypeTable = makeEtherTypeTable();
+
+	constexpr bool etherTypeTableComplete() {
+		for (const auto& entry : etherTypes)
+			if (etherTypeTable[foldEtherType(entry.type)].type != entry.type) return false;
+		return true;
+	}
+	static_assert(etherTypeTableComplete(), "EtherType dispatch table collision, adjust foldEtherType");
+
+	//IPv4 payload protocols
+	constexpr std::array<Layer, 256> makeIPv4ProtocolTable() {
+		std::array<Layer, 256> table{};
+		for (auto& layer : table) layer = Layer::Unsupported;
+		table[IPPROTO_UDP_Value] = Layer::UDP;
+		table[IPPROTO_GRE_Value] = Layer::GRE;
+		table[IPPROTO_IPv4_Value] = Layer::IPv4;
+		table[IPPROTO_IPv6_Value] = Layer::IPv6;
+		return table;
+	}
+	constexpr std::array<Layer, 256> ipv4ProtocolTable = makeIPv4ProtocolTable();
+
+	//IPv6 next headers, payload protocols plus extension headers
+	constexpr std::array<Layer, 256> makeIPv6NextHeaderTable() {
+		std::array<Layer, 256> table = makeIPv4ProtocolTable();
+		table[IPPROTO_HopByHop_Value] = Layer::IPv6Ext;
+		table[IPPROTO_Routing_Value] = Layer::IPv6Ext;
+		table[IPPROTO_DestOptions_Value] = Layer::IPv6Ext;
+		table[IPPROTO_Fragment_Value] = Layer::IPv6Frag;
+		return table;
+	}
+	constexpr std::array<Layer, 256> ipv6NextHeaderTable = makeIPv6NextHeaderTable();
+}
+
 PacketParser::PacketParser() : bytesRemaining(0){}
 
+PacketParser::Layer PacketParser::etherTypeLayer(uint16_t type) {
+	const EtherTypeEntry& entry = etherTypeTable[foldEtherType(type)];
+	return (entry.type == type) ? entry.layer : Layer::Unsupported;
+}
+
+PacketParser::Layer PacketParser::ipv4ProtocolLayer(uint8_t protocol) {
+	return ipv4ProtocolTable[protocol];
+}
+
+PacketParser::Layer PacketParser::ipv6NextHeaderLayer(uint8_t nextHeader) {
+	return ipv6NextHeaderTable[nextHeader];
+}
+
 bool PacketParser::parseBytes(const pcap_pkthdr* header, const u_char* pkt_data) {
 	if(!pkt_data || !header) return false;
 	
 	bytesRemaining = header->caplen;
 	cursor = reinterpret_cast<const uint8_t*>(pkt_data);
+	greSequence = false;
+	++counters.frames;
+
+	if (filter && !filter->accept(header, pkt_data)) {
+		++counters.filtered;
+		return false;
+	}
 
-	if (!parseEthernet(header, pkt_data)) return false;
-	if (!parseIPv4(header, pkt_data)) return false;
-	if (!parseUDP(header, pkt_data)) return false;
-	if (!parseTrailer(header, pkt_data)) return false;
+	//Every layer consumes bytes, so the walk always terminates
+	Layer layer = Layer::Ethernet;
+	while (layer < Layer::UDP) {
+		switch (layer) {
+		case Layer::Ethernet: layer = parseEthernet(); break;
+		case Layer::VLAN: layer = parseVLAN(); break;
+		case Layer::MPLS: layer = parseMPLS(); break;
+		case Layer::IPv4: layer = parseIPv4(); break;
+		case Layer::IPv6: layer = parseIPv6(); break;
+		case Layer::IPv6Ext: layer = parseIPv6Ext(); break;
+		case Layer::IPv6Frag: layer = parseIPv6Frag(); break;
+		case Layer::GRE: layer = parseGRE(); break;
+		case Layer::ERSPAN2: layer = parseERSPAN2(); break;
+		case Layer::ERSPAN3: layer = parseERSPAN3(); break;
+		default: layer = Layer::Unsupported; break;
+		}
+	}
+
+	if (layer == Layer::Unsupported) { ++counters.unsupported; return false; }
+	if (layer == Layer::Truncated) { ++counters.truncated; return false; }
 
+	if (!parseUDP(header, pkt_data)) {
+		++counters.truncated;
+		return false;
+	}
+
+	//Not sampled, stats only need seq/port
+	if (sampleRate > 1 && !SeqSample::isSampled(SeqSample::hash(udp.seq), sampleRate)) {
+		trailer.ns = 0;
+		++counters.notSampled;
+		return true;
+	}
+
+	if (!parseTrailer(header, pkt_data)) {
+		++counters.truncated;
+		return false;
+	}
+
+	++counters.decoded;
 	return true;
 }
 
-bool PacketParser::parseEthernet(const pcap_pkthdr* header, const u_char* pkt_data) {
-	if (bytesRemaining == 0) return false;
+PacketParser::Layer PacketParser::parseEthernet() {
 	eth.start = cursor;
-	size_t offset;
+	if (bytesRemaining < Ethernet_Dst_Length + Ethernet_Src_Length + Ethernet_Type_Length) return Layer::Truncated;
 
-	offset = Ethernet_Dst_Length + Ethernet_Src_Length;
-	if (bytesRemaining < offset) return false;
-	cursor += offset;
-	bytesRemaining -= offset;
+	uint16_t ethTypeValue = readBigEndian16(cursor + Ethernet_Dst_Length + Ethernet_Src_Length);
+	advance(Ethernet_Dst_Length + Ethernet_Src_Length + Ethernet_Type_Length);
 
-	offset = Ethernet_VLAN_TPID_Length;
-	if (bytesRemaining < offset) return false;
-	uint16_t tpidValue;
-	std::memcpy(&tpidValue, cursor, sizeof(tpidValue)); 
-	tpidValue = ntohs(tpidValue);
-	cursor += offset;
-	bytesRemaining -= offset;
+	return etherTypeLayer(ethTypeValue);
+}
 
-	uint16_t ethTypeValue;
-	if (tpidValue == Ethernet_VLAN_TPID_Value) { //Is VLAN present
-		offset = Ethernet_VLAN_TCI_Length;
-		if (bytesRemaining < offset) return false;
-		cursor += offset;
-		bytesRemaining -= offset;
-
-		offset = Ethernet_Type_Length;
-		if (bytesRemaining < offset) return false;
-		std::memcpy(&ethTypeValue, cursor, sizeof(ethTypeValue));
-		ethTypeValue = ntohs(ethTypeValue);
-		cursor += offset;
-		bytesRemaining -= offset;
-	}
-	else
-		ethTypeValue = tpidValue;
+PacketParser::Layer PacketParser::parseVLAN() {
+	if (bytesRemaining < Ethernet_VLAN_TCI_Length + Ethernet_Type_Length) return Layer::Truncated;
+	++counters.vlanTags;
 
-	if (ethTypeValue != IPv4_type)
-		return false; // std::cout << "NOT IPv4" << std::endl; //debug
+	uint16_t ethTypeValue = readBigEndian16(cursor + Ethernet_VLAN_TCI_Length);
+	advance(Ethernet_VLAN_TCI_Length + Ethernet_Type_Length);
 
-	return true;
+	return etherTypeLayer(ethTypeValue);
 }
 
-bool PacketParser::parseIPv4(const pcap_pkthdr* header, const u_char* pkt_data) {
-	if (bytesRemaining == 0) return false;
+PacketParser::Layer PacketParser::parseMPLS() {
+	if (bytesRemaining < MPLS_Label_Length) return Layer::Truncated;
+	++counters.mplsLabels;
+
+	bool bottomOfStack = cursor[2] & MPLS_BoS_Mask;
+	advance(MPLS_Label_Length);
+	if (!bottomOfStack) return Layer::MPLS;
+
+	//No payload type in MPLS, guess from first nibble
+	if (bytesRemaining == 0) return Layer::Truncated;
+	switch (cursor[0] >> 4) {
+	case 4: return Layer::IPv4;
+	case 6: return Layer::IPv6;
+	case 0: //Ethernet pseudowire with control word
+		if (!advance(MPLS_PW_ControlWord_Length)) return Layer::Truncated;
+		return Layer::Ethernet;
+	default: return Layer::Unsupported;
+	}
+}
+
+PacketParser::Layer PacketParser::parseIPv4() {
 	ipv4.start = cursor;
-	size_t offset;
+	if (bytesRemaining < IPv4_Min_Header_Length) return Layer::Truncated;
+	if ((cursor[0] >> 4) != 4) return Layer::Unsupported;
 
-	uint8_t options;
-	std::memcpy(&options, cursor, sizeof(options));
-	options = options & 0x0F;
-	uint16_t optionsLength = options * IpV4_IHL_Header_Size / 8;
+	size_t headerLength = (cursor[0] & 0x0F) * IpV4_IHL_Header_Size / 8;
+	if (headerLength < IPv4_Min_Header_Length) return Layer::Unsupported;
 
-	offset = optionsLength;
-	if (bytesRemaining < offset) return false;
-	cursor += offset;
-	bytesRemaining -= offset;
+	//Non-first fragments carry no UDP header
+	if (readBigEndian16(cursor + IPv4_Fragment_Offset) & IPv4_Fragment_Mask) return Layer::Unsupported;
 
-	return true;
+	uint8_t protocol = cursor[IPv4_Protocol_Offset];
+	if (!advance(headerLength)) return Layer::Truncated;
+	++counters.ipv4;
+
+	return ipv4ProtocolLayer(protocol);
+}
+
+PacketParser::Layer PacketParser::parseIPv6() {
+	ipv6.start = cursor;
+	if (bytesRemaining < IPv6_Header_Length) return Layer::Truncated;
+	if ((cursor[0] >> 4) != 6) return Layer::Unsupported;
+
+	uint8_t nextHeader = cursor[IPv6_NextHeader_Offset];
+	advance(IPv6_Header_Length);
+	++counters.ipv6;
+
+	return ipv6NextHeaderLayer(nextHeader);
+}
+
+PacketParser::Layer PacketParser::parseIPv6Ext() {
+	if (bytesRemaining < IPv6_Ext_Min_Length) return Layer::Truncated;
+
+	uint8_t nextHeader = cursor[0];
+	size_t length = ((size_t)cursor[1] + 1) * 8;
+	if (!advance(length)) return Layer::Truncated;
+
+	return ipv6NextHeaderLayer(nextHeader);
+}
+
+PacketParser::Layer PacketParser::parseIPv6Frag() {
+	if (bytesRemaining < IPv6_Fragment_Header_Length) return Layer::Truncated;
+
+	uint8_t nextHeader = cursor[0];
+	if (readBigEndian16(cursor + 2) >> 3) return Layer::Unsupported; //Non-first fragment
+	advance(IPv6_Fragment_Header_Length);
+
+	return ipv6NextHeaderLayer(nextHeader);
+}
+
+PacketParser::Layer PacketParser::parseGRE() {
+	if (bytesRemaining < GRE_Base_Length) return Layer::Truncated;
+
+	uint16_t flags = readBigEndian16(cursor);
+	uint16_t protocolType = readBigEndian16(cursor + 2);
+	if ((flags & GRE_Version_Mask) != 0 || (flags & GRE_Routing_Flag)) return Layer::Unsupported;
+
+	size_t length = GRE_Base_Length;
+	if (flags & GRE_Checksum_Flag) length += GRE_Optional_Length;
+	if (flags & GRE_Key_Flag) length += GRE_Optional_Length;
+	if (flags & GRE_Sequence_Flag) length += GRE_Optional_Length;
+	greSequence = (flags & GRE_Sequence_Flag) != 0;
+
+	if (!advance(length)) return Layer::Truncated;
+	++counters.gre;
+
+	return etherTypeLayer(protocolType);
+}
+
+PacketParser::Layer PacketParser::parseERSPAN2() {
+	++counters.erspan;
+	if (!greSequence) return Layer::Ethernet; //ERSPAN I, no header
+
+	if (bytesRemaining < ERSPAN2_Header_Length) return Layer::Truncated;
+	if ((cursor[0] >> 4) != ERSPAN2_Version) return Layer::Unsupported;
+	advance(ERSPAN2_Header_Length);
+
+	return Layer::Ethernet;
+}
+
+PacketParser::Layer PacketParser::parseERSPAN3() {
+	++counters.erspan;
+	if (bytesRemaining < ERSPAN3_Header_Length) return Layer::Truncated;
+	if ((cursor[0] >> 4) != ERSPAN3_Version) return Layer::Unsupported;
+
+	size_t length = ERSPAN3_Header_Length;
+	if (cursor[ERSPAN3_Header_Length - 1] & ERSPAN3_Subheader_Flag) length += ERSPAN3_Subheader_Length;
+	if (!advance(length)) return Layer::Truncated;
+
+	return Layer::Ethernet;
 }
 
 bool PacketParser::parseUDP(const pcap_pkthdr* header, const u_char* pkt_data) {
@@ -104,7 +298,9 @@ bool PacketParser::parseUDP(const pcap_pkthdr* header, const u_char* pkt_data) {
 	if (bytesRemaining < offset) return false;
 	uint16_t dataLength;
 	std::memcpy(&dataLength, cursor, sizeof(dataLength));
-	dataLength = ntohs(dataLength) - UDP_Src_Length - UDP_Dst_Length - UDP_Len_Length - UDP_Checksum_Length;
+	dataLength = ntohs(dataLength);
+	if (dataLength < UDP_Src_Length + UDP_Dst_Length + UDP_Len_Length + UDP_Checksum_Length) return false;
+	dataLength = dataLength - UDP_Src_Length - UDP_Dst_Length - UDP_Len_Length - UDP_Checksum_Length;
 	cursor += offset;
 	bytesRemaining -= offset;
 
@@ -147,3 +343,29 @@ uint32_t PacketParser::getSequence() {return udp.seq;}
 uint16_t PacketParser::getPort() {return udp.port;}
 
 uint64_t PacketParser::getTimestamp() {return trailer.ns;}
+
+const PacketParser::DecodeCounters& PacketParser::getCounters() const {return counters;}
+
+void PacketParser::setSampleRate(uint32_t rate) { sampleRate = (rate == 0) ? 1 : rate; }
+
+void PacketParser::setFilter(const PacketFilter* filter) { this->filter = filter; }
+
+void PacketParser::addCounters(const DecodeCounters& other) { counters += other; }
+
+void PacketParser::printCounters() const {
+	std::cout << "===== Decode Summary =====\n";
+	std::cout << std::left << std::setw(30) << "Frames seen" << counters.frames << std::endl;
+	std::cout << std::left << std::setw(30) << "Frames decoded" << counters.decoded << std::endl;
+	if (filter) std::cout << std::left << std::setw(30) << "Dropped by pre-parse filter" << counters.filtered << std::endl;
+	std::cout << std::left << std::setw(30) << "Dropped unsupported" << counters.unsupported << std::endl;
+	std::cout << std::left << std::setw(30) << "Dropped truncated" << counters.truncated << std::endl;
+	if (sampleRate > 1) std::cout << std::left << std::setw(30) << "Not sampled" << counters.notSampled << std::endl;
+
+	std::cout << std::endl;
+	std::cout << std::left << std::setw(30) << "VLAN tags" << counters.vlanTags << std::endl;
+	std::cout << std::left << std::setw(30) << "MPLS labels" << counters.mplsLabels << std::endl;
+	std::cout << std::left << std::setw(30) << "IPv4 headers" << counters.ipv4 << std::endl;
+	std::cout << std::left << std::setw(30) << "IPv6 headers" << counters.ipv6 << std::endl;
+	std::cout << std::left << std::setw(30) << "GRE headers" << counters.gre << std::endl;
+	std::cout << std::left << std::setw(30) << "ERSPAN headers" << counters.erspan << std::endl;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <pcap.h>
+#include "SeqSample.h"
 
 #define Ethernet_Dst_Length 6
 #define Ethernet_Src_Length 6
@@ -8,6 +9,8 @@
 #define Ethernet_VLAN_TCI_Length 2
 #define Ethernet_Type_Length 2
 #define Ethernet_VLAN_TPID_Value 0x8100
+#define Ethernet_QinQ_TPID_Value 0x88A8
+#define Ethernet_QinQ_Legacy_TPID_Value 0x9100
 
 #define IPv4_Ver_IHL_Length 1
 #define IPv4_DSCP_ECN_Length 1
@@ -20,6 +23,34 @@
 #define IPv4_Src_Length 4
 #define IPv4_Dst_Length 4
 #define IpV4_IHL_Header_Size 32
+#define IPv4_Min_Header_Length 20
+#define IPv4_Fragment_Offset 6 //Flags + fragment offset field
+#define IPv4_Protocol_Offset 9
+#define IPv4_Fragment_Mask 0x1FFF
+
+#define IPv6_Header_Length 40
+#define IPv6_NextHeader_Offset 6
+#define IPv6_Ext_Min_Length 8
+#define IPv6_Fragment_Header_Length 8
+
+#define MPLS_Label_Length 4
+#define MPLS_BoS_Mask 0x01
+#define MPLS_PW_ControlWord_Length 4
+
+#define GRE_Base_Length 4
+#define GRE_Optional_Length 4
+#define GRE_Checksum_Flag 0x8000
+#define GRE_Routing_Flag 0x4000
+#define GRE_Key_Flag 0x2000
+#define GRE_Sequence_Flag 0x1000
+#define GRE_Version_Mask 0x0007
+
+#define ERSPAN2_Header_Length 8
+#define ERSPAN3_Header_Length 12
+#define ERSPAN3_Subheader_Length 8
+#define ERSPAN3_Subheader_Flag 0x01
+#define ERSPAN2_Version 1
+#define ERSPAN3_Version 2
 
 #define UDP_Src_Length 2
 #define UDP_Dst_Length 2
@@ -33,11 +64,58 @@
 #define Trailer_Nanoseconds_Length 4
 
 #define IPv4_type 0x0800
+#define IPv6_type 0x86DD
+#define MPLS_Unicast_type 0x8847
+#define MPLS_Multicast_type 0x8848
+#define ERSPAN2_type 0x88BE
+#define ERSPAN3_type 0x22EB
+#define TransparentEthernet_type 0x6558
+
+#define IPPROTO_HopByHop_Value 0
+#define IPPROTO_IPv4_Value 4
+#define IPPROTO_UDP_Value 17
+#define IPPROTO_IPv6_Value 41
+#define IPPROTO_Routing_Value 43
+#define IPPROTO_Fragment_Value 44
+#define IPPROTO_GRE_Value 47
+#define IPPROTO_DestOptions_Value 60
+
+class PacketFilter;
 
 /*
 Parse 1 packet into internal views
+-Layered decoder: Ethernet, stacked VLAN/QinQ tags, MPLS label stacks,
+ GRE (incl. ERSPAN I/II/III), IPv4 and IPv6 down to the innermost UDP
+-Next layer is chosen by table lookup on EtherType / IP protocol
 */
 class PacketParser {
+public:
+	//Decode states, anything from UDP onward ends the layer walk
+	enum class Layer : uint8_t { Ethernet, VLAN, MPLS, IPv4, IPv6, IPv6Ext, IPv6Frag, GRE, ERSPAN2, ERSPAN3, UDP, Unsupported, Truncated };
+
+	//Decode-path counters, one increment per layer visited
+	struct DecodeCounters {
+		uint64_t frames = 0;
+		uint64_t decoded = 0;
+		uint64_t vlanTags = 0;
+		uint64_t mplsLabels = 0;
+		uint64_t ipv4 = 0;
+		uint64_t ipv6 = 0;
+		uint64_t gre = 0;
+		uint64_t erspan = 0;
+		uint64_t unsupported = 0;
+		uint64_t truncated = 0;
+		uint64_t notSampled = 0;	//Approximate mode, trailer skipped
+		uint64_t filtered = 0;		//Rejected by PacketFilter before decoding
+
+		DecodeCounters& operator+=(const DecodeCounters& other) {
+			frames += other.frames; decoded += other.decoded; vlanTags += other.vlanTags; mplsLabels += other.mplsLabels;
+			ipv4 += other.ipv4; ipv6 += other.ipv6; gre += other.gre; erspan += other.erspan;
+			unsupported += other.unsupported; truncated += other.truncated; notSampled += other.notSampled; filtered += other.filtered;
+			return *this;
+		}
+	};
+
 private:
 	struct EthernetView {
 		const uint8_t* start = nullptr; 
@@ -47,6 +125,10 @@ private:
 		const uint8_t* start = nullptr;
 	};
 
+	struct IPv6View {
+		const uint8_t* start = nullptr;
+	};
+
 	struct UDPView {
 		const uint8_t* start = nullptr;
 		uint32_t seq = 0;
@@ -59,8 +141,13 @@ private:
 
 	EthernetView eth{};
 	IPv4View ipv4{};
+	IPv6View ipv6{};
 	UDPView udp{};
 	TrailerView trailer{};
+	DecodeCounters counters{};
+	uint32_t sampleRate = 1;
+	const PacketFilter* filter = nullptr;
+	bool greSequence = false; //ERSPAN I has no header, told apart from II by GRE S bit
 
 public:
 	PacketParser();
@@ -79,11 +166,66 @@ public:
 	uint32_t getSequence();
 	uint16_t getPort();
 	uint64_t getTimestamp();
+	const DecodeCounters& getCounters() const;
+
+	/*
+	Approximate mode, only fully parse 1 in sampleRate seqs (SeqSample, same seqs as ApproxStats)
+	Non-sampled packets still return seq/port for the sketches, timestamp is 0
+	Inputs:
+			rate	-Sample rate, 1 parses everything
+	*/
+	void setSampleRate(uint32_t rate);
+
+	/*
+	Run a pre-parse filter on every frame before decoding, must outlive the parser
+	Inputs:
+			filter	-Filter to apply, nullptr to decode everything
+	*/
+	void setFilter(const PacketFilter* filter);
+
+	/*
+	Add counters from another parser, e.g. merged shard snapshots
+	*/
+	void addCounters(const DecodeCounters& other);
+
+	/*
+	Print decode-path counters
+	*/
+	void printCounters() const;
+
+	/*
+	Next layer lookup
+	Inputs:
+			type/protocol	-EtherType (also GRE protocol type), IPv4 protocol or IPv6 next header
+	Outputs:
+			Layer			-Layer to decode next, Unsupported if not handled
+	*/
+	static Layer etherTypeLayer(uint16_t type);
+	static Layer ipv4ProtocolLayer(uint8_t protocol);
+	static Layer ipv6NextHeaderLayer(uint8_t nextHeader);
 
 private:
 	size_t bytesRemaining = 0;
 	const uint8_t* cursor = nullptr;
 
+	/*
+	Helper functions
+	Parse encapsulation headers
+	Leave cursor just after end of header
+	Outputs:
+			Layer		-Next layer to decode, Unsupported/Truncated to drop the packet
+	*/
+	Layer parseEthernet();
+	Layer parseVLAN();
+	Layer parseMPLS();
+	Layer parseIPv4();
+	Layer parseIPv6();
+	Layer parseIPv6Ext();
+	Layer parseIPv6Frag();
+	Layer parseGRE();
+	Layer parseERSPAN2();
+	Layer parseERSPAN3();
+
 	/*
 	Helper functions
 	Parse headers/trailer
@@ -94,8 +236,6 @@ private:
 	Outputs:
 			true/false	-True if header/trailer parsing succeeded
 	*/
-	bool parseEthernet(const pcap_pkthdr* header, const u_char* pkt_data);
-	bool parseIPv4(const pcap_pkthdr* header, const u_char* pkt_data);
 	bool parseUDP(const pcap_pkthdr* header, const u_char* pkt_data);
 	bool parseTrailer(const pcap_pkthdr* header, const u_char* pkt_data);
 
@@ -115,4 +255,31 @@ private:
 			| (uint32_t)ptr[3] << 24;
 	}
 
+	/*
+	Helper function
+	Read a big-endian (network order) 16-bit integer
+	Inputs:
+			ptr			-Pointer to start of 16bit data
+	Outputs:
+			uint16_t	-Value
+	*/
+	uint16_t readBigEndian16(const uint8_t* ptr) {
+		return (uint16_t)((uint16_t)ptr[0] << 8 | (uint16_t)ptr[1]);
+	}
+
+	/*
+	Helper function
+	Move cursor forward
+	Inputs:
+			length		-Bytes to skip
+	Outputs:
+			true/false	-False if fewer than length bytes remain
+	*/
+	bool advance(size_t length) {
+		if (bytesRemaining < length) return false;
+		cursor += length;
+		bytesRemaining -= length;
+		return true;
+	}
+
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <pcap.h>
+
+#define Pcap_Global_Header_Length 24
+#define Pcap_Record_Header_Length 16
+#define Pcap_Snaplen_Offset 16	//In the global header
+#define Pcap_LinkType_Offset 20
+#define Pcap_Magic_Micro 0xA1B2C3D4
+#define Pcap_Magic_Nano 0xA1B23C4D
+#define Pcap_Max_Record_Length (256 * 1024)
+
+/*
+Classic pcap header decoding/encoding, and little-endian fixed width fields
+-One copy for UringReader, PcapHandler and SliceIndex so byte order and
+ nanosecond magic handling can't drift apart
+-putFixed/getFixed are also the snapshot and .idx file encoding
+*/
+namespace PcapFormat {
+	//Global header fields that matter to readers and writers
+	struct FileHeader {
+		bool swapped = false;	//Written on opposite endianness
+		bool nanoseconds = false;
+		uint32_t snaplen = 0;
+		uint32_t linkType = 0;
+	};
+
+	//Record header as stored, fraction is us or ns per FileHeader
+	struct RecordHeader {
+		uint32_t seconds = 0;
+		uint32_t fraction = 0;
+		uint32_t caplen = 0;
+		uint32_t len = 0;
+	};
+
+	inline void putFixed(std::vector<uint8_t>& out, uint64_t value, size_t bytes) {
+		for (size_t i = 0; i < bytes; ++i) out.push_back(uint8_t(value >> (8 * i)));
+	}
+
+	inline uint64_t getFixed(const uint8_t* ptr, size_t bytes) {
+		uint64_t value = 0;
+		for (size_t i = 0; i < bytes; ++i) value |= (uint64_t)ptr[i] << (8 * i);
+		return value;
+	}
+
+	//32bit pcap field in the file's byte order
+	inline uint32_t read32(const uint8_t* ptr, bool swapped) {
+		if (swapped)
+			return (uint32_t)ptr[3] | (uint32_t)ptr[2] << 8 | (uint32_t)ptr[1] << 16 | (uint32_t)ptr[0] << 24;
+		return (uint32_t)getFixed(ptr, 4);
+	}
+
+	inline void write32(uint8_t* ptr, uint32_t value, bool swapped) {
+		for (int i = 0; i < 4; ++i) ptr[swapped ? 3 - i : i] = uint8_t(value >> (8 * i));
+	}
+
+	/*
+	Decode the magic number (first 4 bytes)
+	Outputs:
+			true/false	-False if not classic pcap (pcapng, ...)
+	*/
+	inline bool readMagic(const uint8_t* data, FileHeader& header) {
+		for (bool swapped : { false, true }) {
+			uint32_t magic = read32(data, swapped);
+			if (magic == Pcap_Magic_Micro || magic == Pcap_Magic_Nano) {
+				header.swapped = swapped;
+				header.nanoseconds = (magic == Pcap_Magic_Nano);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/*
+	Decode a Pcap_Global_Header_Length byte global header
+	Outputs:
+			true/false	-False if not classic pcap
+	*/
+	inline bool readFileHeader(const uint8_t* data, FileHeader& header) {
+		if (!readMagic(data, header)) return false;
+		header.snaplen = read32(data + Pcap_Snaplen_Offset, header.swapped);
+		header.linkType = read32(data + Pcap_LinkType_Offset, header.swapped);
+		return true;
+	}
+
+	inline RecordHeader readRecordHeader(const uint8_t* data, bool swapped) {
+		return { read32(data, swapped), read32(data + 4, swapped), read32(data + 8, swapped), read32(data + 12, swapped) };
+	}
+
+	inline void writeRecordHeader(uint8_t* data, const RecordHeader& record, bool swapped) {
+		write32(data, record.seconds, swapped);
+		write32(data + 4, record.fraction, swapped);
+		write32(data + 8, record.caplen, swapped);
+		write32(data + 12, record.len, swapped);
+	}
+
+	//Timestamp fraction converted between us and ns
+	inline uint32_t convertFraction(uint32_t fraction, bool fromNanoseconds, bool toNanoseconds) {
+		if (fromNanoseconds && !toNanoseconds) return fraction / 1000;
+		if (!fromNanoseconds && toNanoseconds) return fraction * 1000;
+		return fraction;
+	}
+
+	//libpcap style header, timestamps always in microseconds
+	inline void toPkthdr(const RecordHeader& record, bool nanoseconds, pcap_pkthdr& header) {
+		header.ts.tv_sec = record.seconds;
+		header.ts.tv_usec = convertFraction(record.fraction, nanoseconds, false);
+		header.caplen = record.caplen;
+		header.len = record.len;
+	}
+}
@@ -1,6 +1,18 @@
 #include <iostream>
 #include <cstring>
+#include <fstream>
 #include "PcapHandler.h"
+#include "PcapFormat.h"
+
+namespace {
+	//Classic pcap (either byte order, micro or nano), records are a plain 16 byte header + caplen
+	bool isClassicPcap(const char* filename) {
+		std::ifstream file(filename, std::ios::binary);
+		uint8_t magic[4];
+		PcapFormat::FileHeader header;
+		return file.read(reinterpret_cast<char*>(magic), sizeof(magic)) && PcapFormat::readMagic(magic, header);
+	}
+}
 
 #ifdef _WIN32
 bool PcapHandler::LoadNpcapDlls()
@@ -19,7 +31,15 @@ bool PcapHandler::LoadNpcapDlls()
 }
 #endif
 
-PcapHandler::PcapHandler(const char* filename): valid(true), fp(nullptr), pkt_header(nullptr), pkt_data(nullptr) {
+PcapHandler::PcapHandler(const char* filename, unsigned queueDepth): valid(true), fp(nullptr), pkt_header(nullptr), pkt_data(nullptr) {
+#ifdef FLOW_HAVE_URING
+	if (queueDepth != 0) {
+		uring = std::make_unique<UringReader>(filename, queueDepth);
+		if (uring->isValid()) return;
+		uring.reset(); //Fall back to libpcap
+	}
+#endif
+
 #ifdef _WIN32
 	if (!(valid = LoadNpcapDlls())) return;
 #endif
@@ -28,11 +48,14 @@ PcapHandler::PcapHandler(const char* filename): valid(true), fp(nullptr), pkt_he
 	if ((fp = pcap_open_offline(filename, errbuf)) == NULL){
 		valid = false;
 		std::cerr << "Unable to open the file: " << filename << std::endl;
+		return;
 	}
+	if (isClassicPcap(filename)) nextOffset = Pcap_Global_Header_Length;
 }
 PcapHandler::~PcapHandler() { if (fp) pcap_close(fp); }
 
-PcapHandler::PcapHandler(PcapHandler&& other) noexcept : valid(other.valid), pkt_header(other.pkt_header), pkt_data(other.pkt_data), fp(other.fp){
+PcapHandler::PcapHandler(PcapHandler&& other) noexcept : valid(other.valid), pkt_header(other.pkt_header), pkt_data(other.pkt_data), fp(other.fp), uring(std::move(other.uring)),
+	recordOffset(other.recordOffset), nextOffset(other.nextOffset) {
 	std::memcpy(errbuf, other.errbuf, sizeof(errbuf));
 	
 	other.valid = false;
@@ -50,7 +73,10 @@ PcapHandler& PcapHandler::operator=(PcapHandler&& other) noexcept {
 	pkt_data = other.pkt_data;
 	if (fp) pcap_close(fp);
 	fp = other.fp;
+	uring = std::move(other.uring);
 	std::memcpy(errbuf, other.errbuf, sizeof(errbuf));
+	recordOffset = other.recordOffset;
+	nextOffset = other.nextOffset;
 
 	other.valid = false;
 	other.pkt_header = nullptr;
@@ -64,9 +90,30 @@ PcapHandler& PcapHandler::operator=(PcapHandler&& other) noexcept {
 bool PcapHandler::isValid() const { return valid; }
 
 PcapHandler::NextResult PcapHandler::getNextPacket() {
+	if (uring) {
+		switch (uring->getNextPacket()) {
+		case UringReader::Status::Packet:
+			pkt_header = uring->getHeader();
+			pkt_data = uring->getData();
+			return NextResult::Success;
+		case UringReader::Status::Eof:
+			return NextResult::Eof;
+		default:
+			std::cerr << "Read error" << std::endl;
+			return NextResult::Error;
+		}
+	}
+
 	//auto retxx = pcap_datalink(fp);
 	NextResult ret = (NextResult)pcap_next_ex(fp, &pkt_header, &pkt_data);
 	if (ret == NextResult::Error) std::cerr << pcap_geterr(fp) << std::endl;
+	if (ret != NextResult::Success) return ret;
+
+	//Only a record shorter than the snaplen (or complete) is known to be its on-disk length
+	recordOffset = nextOffset;
+	bool untruncated = pkt_header->caplen < (bpf_u_int32)pcap_snapshot(fp) || pkt_header->caplen == pkt_header->len;
+	if (nextOffset != Pcap_Unknown_Offset && untruncated) nextOffset += Pcap_Record_Header_Length + pkt_header->caplen;
+	else nextOffset = Pcap_Unknown_Offset;
 	return ret;
 }
 
@@ -77,3 +124,21 @@ const pcap_pkthdr* PcapHandler::getHeader() const {
 const u_char* PcapHandler::getData() const {
 	return pkt_data;
 }
+
+uint64_t PcapHandler::getRecordOffset() const {
+	return uring ? uring->getRecordOffset() : recordOffset;
+}
+
+bool PcapHandler::setFilter(const std::string& expression) {
+	if (!fp) return false;
+
+	bpf_program program;
+	if (pcap_compile(fp, &program, expression.c_str(), 1, PCAP_NETMASK_UNKNOWN) != 0) {
+		std::cerr << "Unable to compile filter: " << pcap_geterr(fp) << std::endl;
+		return false;
+	}
+	bool success = pcap_setfilter(fp, &program) == 0;
+	if (!success) std::cerr << "Unable to set filter: " << pcap_geterr(fp) << std::endl;
+	pcap_freecode(&program);
+	return success;
+}
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <pcap.h>
+#include "UringReader.h"
 #ifdef _WIN32
 #include <tchar.h>
 #endif
@@ -10,8 +14,12 @@
 #define PCAP_ERROR_BREAK		-2	/* loop terminated by pcap_breakloop */
 #define PCAP_ERROR_NOT_ACTIVATED	-3	/* the capture needs to be activated */
 
+#define Pcap_Unknown_Offset UINT64_MAX
+
 /*
 Wrapper class to open, handle, and close pcap file
+-On Linux, classic pcap files are read through io_uring/O_DIRECT (UringReader)
+-Falls back to libpcap when io_uring is unavailable or the file isn't classic pcap
 */
 class PcapHandler {
 public:
@@ -22,15 +30,19 @@ private:
 	struct pcap_pkthdr* pkt_header{};
 	const u_char* pkt_data = nullptr;
 	pcap_t* fp = nullptr;
+	std::unique_ptr<UringReader> uring;
 	char errbuf[PCAP_ERRBUF_SIZE] = { 0 };
+	uint64_t recordOffset = Pcap_Unknown_Offset;	//libpcap path, tracked from record lengths
+	uint64_t nextOffset = Pcap_Unknown_Offset;
 	
 public:
 	/*
 	Open a pcap file for offline reading
 	Inputs:
 			filename	-pcap file path
+			queueDepth	-io_uring reads in flight, 0 to always use libpcap
 	*/
-	PcapHandler(const char* filename);
+	PcapHandler(const char* filename, unsigned queueDepth = Uring_Default_Queue_Depth);
 	~PcapHandler();
 	PcapHandler(const PcapHandler&) = delete; //We own pcap_t* fp, care for file close
 	PcapHandler& operator=(const PcapHandler&) = delete;
@@ -52,6 +64,24 @@ public:
 	const pcap_pkthdr* getHeader() const;
 	const u_char* getData() const;
 
+	/*
+	File offset of the current record header, for seeking back to it later
+	-libpcap path: classic pcap only, counted from record lengths, unknown from
+	 the first record whose caplen libpcap may have cut down to the snaplen
+	Outputs:
+			uint64_t	-Offset, Pcap_Unknown_Offset if the backend can't tell
+	*/
+	uint64_t getRecordOffset() const;
+
+	/*
+	Install a BPF filter on the libpcap handle (kernel side for live captures)
+	Inputs:
+			expression	-libpcap filter expression, e.g. PacketFilter::bpfExpression()
+	Outputs:
+			true/false	-False if it doesn't compile, or no libpcap handle (io_uring reader)
+	*/
+	bool setFilter(const std::string& expression);
+
 private:
 	/*
 	Set DLL search path for npcap
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+/*
+Deterministic 1 in N MsgSeqNum sample
+-Shared by PacketParser and ApproxStats so both keep the same seqs
+*/
+namespace SeqSample {
+	/*
+	Hash a MsgSeqNum, also used to feed the HyperLogLog sketches
+	*/
+	inline uint64_t hash(uint32_t seq) {
+		uint64_t hash = seq + 0x9E3779B97F4A7C15ull; //splitmix64 finalizer
+		hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+		hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+		return hash ^ (hash >> 31);
+	}
+
+	inline bool isSampled(uint64_t hash, uint32_t sampleRate) { return (uint32_t)hash % sampleRate == 0; }
+}
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+#include "SliceIndex.h"
+#include "PacketParser.h"
+#include "PcapFormat.h"
+#include "PcapHandler.h"
+
+namespace {
+	const size_t Block_Bytes = 8 + 4 + 4 + 8 + 8;
+
+	struct Record {
+		PcapFormat::RecordHeader stored;	//As on disk, fraction us or ns per file
+		pcap_pkthdr header{};
+		std::vector<uint8_t> data;
+	};
+
+	//Classic pcap reader over raw record headers, no libpcap involved
+	class RecordReader {
+	private:
+		std::ifstream in;
+		bool failed = false;
+
+	public:
+		uint8_t globalHeader[Pcap_Global_Header_Length] = {};
+		PcapFormat::FileHeader format;
+
+		bool open(const std::string& path) {
+			in.open(path, std::ios::binary);
+			return in.read(reinterpret_cast<char*>(globalHeader), sizeof(globalHeader)) && PcapFormat::readFileHeader(globalHeader, format);
+		}
+
+		void seek(uint64_t offset) {
+			in.clear();
+			in.seekg((std::streamoff)offset);
+		}
+
+		//False at end of file or on a bad record, error() tells them apart
+		bool next(Record& record) {
+			uint8_t recordHeader[Pcap_Record_Header_Length];
+			if (!in.read(reinterpret_cast<char*>(recordHeader), sizeof(recordHeader))) return false;
+
+			record.stored = PcapFormat::readRecordHeader(recordHeader, format.swapped);
+			PcapFormat::toPkthdr(record.stored, format.nanoseconds, record.header);
+			if (record.header.caplen > Pcap_Max_Record_Length) return !(failed = true);
+
+			record.data.resize(record.header.caplen);
+			if (!in.read(reinterpret_cast<char*>(record.data.data()), record.data.size())) return !(failed = true);
+			return true;
+		}
+
+		bool error() const { return failed; }
+	};
+}
+
+SliceIndex::SliceIndex(uint32_t interval) : interval(std::max<uint32_t>(interval, 1)) {}
+
+void SliceIndex::addRecord(uint64_t offset) {
+	//Offsets only make sense for classic pcap, first record right after the global header
+	if (offset == Pcap_Unknown_Offset || (blocks.empty() && offset != Pcap_Global_Header_Length)) valid = false;
+	if (!valid) return;
+
+	if (inBlock == 0) {
+		blocks.emplace_back();
+		blocks.back().offset = offset;
+	}
+	if (++inBlock == interval) inBlock = 0;
+}
+
+void SliceIndex::addPacket(uint32_t seq, uint64_t ts_ns) {
+	if (!valid || blocks.empty()) return;
+	Block& block = blocks.back();
+	block.minSeq = std::min<uint32_t>(block.minSeq, seq);
+	block.maxSeq = std::max<uint32_t>(block.maxSeq, seq);
+	block.minTs = std::min<uint64_t>(block.minTs, ts_ns);
+	block.maxTs = std::max<uint64_t>(block.maxTs, ts_ns);
+}
+
+void SliceIndex::finish(uint64_t size) { fileSize = size; }
+
+bool SliceIndex::isValid() const { return valid; }
+
+size_t SliceIndex::size() const { return blocks.size(); }
+
+bool SliceIndex::save(const std::string& path) const {
+	if (!valid) return false;
+
+	std::vector<uint8_t> out;
+	out.reserve(Slice_Index_Magic_Length + 20 + blocks.size() * Block_Bytes);
+	out.insert(out.end(), Slice_Index_Magic, Slice_Index_Magic + Slice_Index_Magic_Length);
+	PcapFormat::putFixed(out, fileSize, 8);
+	PcapFormat::putFixed(out, interval, 4);
+	PcapFormat::putFixed(out, blocks.size(), 8);
+	for (const Block& block : blocks) {
+		PcapFormat::putFixed(out, block.offset, 8);
+		PcapFormat::putFixed(out, block.minSeq, 4);
+		PcapFormat::putFixed(out, block.maxSeq, 4);
+		PcapFormat::putFixed(out, block.minTs, 8);
+		PcapFormat::putFixed(out, block.maxTs, 8);
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(out.data()), out.size());
+	return file.good();
+}
+
+bool SliceIndex::load(const std::string& path, uint64_t expectedFileSize) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	const size_t headerBytes = Slice_Index_Magic_Length + 8 + 4 + 8;
+	if (data.size() < headerBytes || !std::equal(data.begin(), data.begin() + Slice_Index_Magic_Length, Slice_Index_Magic)) return false;
+
+	const uint8_t* cursor = data.data() + Slice_Index_Magic_Length;
+	auto getFixed = [&cursor](size_t bytes) {
+		uint64_t value = PcapFormat::getFixed(cursor, bytes);
+		cursor += bytes;
+		return value;
+	};
+	uint64_t size = getFixed(8);
+	uint32_t storedInterval = (uint32_t)getFixed(4);
+	uint64_t count = getFixed(8);
+	if (size != expectedFileSize || data.size() != headerBytes + count * Block_Bytes) return false; //Stale or corrupt
+
+	blocks.resize(count);
+	for (Block& block : blocks) {
+		block.offset = getFixed(8);
+		block.minSeq = (uint32_t)getFixed(4);
+		block.maxSeq = (uint32_t)getFixed(4);
+		block.minTs = getFixed(8);
+		block.maxTs = getFixed(8);
+	}
+	fileSize = size;
+	interval = std::max<uint32_t>(storedInterval, 1);
+	inBlock = 0;
+	valid = true;
+	return true;
+}
+
+bool SliceIndex::build(const std::string& pcapPath) {
+	RecordReader reader;
+	if (!reader.open(pcapPath)) return false;
+
+	PacketParser parser;
+	Record record;
+	uint64_t offset = Pcap_Global_Header_Length;
+	while (reader.next(record)) {
+		addRecord(offset);
+		offset += Pcap_Record_Header_Length + record.header.caplen;
+		if (parser.parseBytes(&record.header, record.data.data()) && Stats::toSide(parser.getPort()))
+			addPacket(parser.getSequence(), parser.getTimestamp());
+	}
+
+	std::error_code error;
+	uint64_t size = std::filesystem::file_size(pcapPath, error);
+	finish(error ? 0 : size);
+	return valid && !error && !reader.error();
+}
+
+std::optional<size_t> SliceIndex::extract(const std::string& pcapPath, const Query& query, std::ofstream& out, OutputFormat& format) const {
+	if (!valid) return std::nullopt;
+
+	RecordReader reader;
+	if (!reader.open(pcapPath)) return std::nullopt;
+	if (!format.started) {
+		out.write(reinterpret_cast<const char*>(reader.globalHeader), sizeof(reader.globalHeader));
+		format = { true, reader.format.swapped, reader.format.nanoseconds, reader.format.snaplen, reader.format.linkType };
+	}
+	else if (reader.format.linkType != format.linkType) {
+		std::cerr << "Linktype " << reader.format.linkType << " does not match output linktype " << format.linkType << ": " << pcapPath << std::endl;
+		return std::nullopt;
+	}
+
+	//Offset ranges [start, end) of blocks overlapping the query, adjacent blocks merged
+	std::vector<std::pair<uint64_t, uint64_t>> ranges;
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		const Block& block = blocks[i];
+		bool overlaps = (query.key == Key::Seq)
+			? block.minSeq <= query.to && block.maxSeq >= query.from
+			: block.minTs <= query.to && block.maxTs >= query.from;
+		if (!overlaps) continue;
+
+		uint64_t end = (i + 1 < blocks.size()) ? blocks[i + 1].offset : UINT64_MAX;
+		if (!ranges.empty() && ranges.back().second == block.offset) ranges.back().second = end;
+		else ranges.emplace_back(block.offset, end);
+	}
+
+	PacketParser parser;
+	Record record;
+	size_t written = 0;
+	for (auto [start, end] : ranges) {
+		reader.seek(start);
+
+		for (uint64_t pos = start; pos < end && reader.next(record);) {
+			pos += Pcap_Record_Header_Length + record.header.caplen;
+
+			if (!parser.parseBytes(&record.header, record.data.data())) continue;
+			std::optional<Stats::Side> side = Stats::toSide(parser.getPort());
+			if (!side || (query.side && *side != *query.side)) continue;
+			uint64_t key = (query.key == Key::Seq) ? parser.getSequence() : parser.getTimestamp();
+			if (key < query.from || key > query.to) continue;
+
+			//Re-encode in the output's byte order and precision
+			PcapFormat::RecordHeader stored = record.stored;
+			stored.fraction = PcapFormat::convertFraction(stored.fraction, reader.format.nanoseconds, format.nanoseconds);
+			uint8_t recordHeader[Pcap_Record_Header_Length];
+			PcapFormat::writeRecordHeader(recordHeader, stored, format.swapped);
+			out.write(reinterpret_cast<const char*>(recordHeader), sizeof(recordHeader));
+			out.write(reinterpret_cast<const char*>(record.data.data()), record.data.size());
+			++written;
+
+			//Readers may drop records longer than the header's snaplen
+			if (record.header.caplen > format.snaplen) {
+				uint8_t snaplen[4];
+				format.snaplen = record.header.caplen;
+				PcapFormat::write32(snaplen, format.snaplen, format.swapped);
+				std::streampos position = out.tellp();
+				out.seekp(Pcap_Snaplen_Offset);
+				out.write(reinterpret_cast<const char*>(snaplen), sizeof(snaplen));
+				out.seekp(position);
+			}
+		}
+		if (reader.error()) return std::nullopt;
+	}
+
+	if (!out) return std::nullopt;
+	return written;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "Stats.h"
+
+#define Slice_Index_Interval 1024 //Records per index entry
+#define Slice_Index_Magic "FLOWIDX1"
+#define Slice_Index_Magic_Length 8
+#define Slice_Index_Extension ".idx"
+
+/*
+Sparse seq/timestamp -> file offset index for one classic pcap file
+-One block per Slice_Index_Interval records: offset of its first record, seq and timestamp range of A/B packets in it
+-Built inline during an --index analysis pass or on demand by --extract, saved next to the capture as <file>.idx
+-Extraction only reads blocks whose range overlaps the query
+
+Usage:
+-Call addRecord(offset) for every record, addPacket(seq, ts_ns) for every parsed A/B packet
+-Call finish(fileSize) then save(indexPath(file))
+*/
+class SliceIndex {
+public:
+	enum class Key { Seq, Time };
+
+	//Inclusive range of seqs or trailer timestamps (ns), side nullopt = both feeds
+	struct Query {
+		Key key = Key::Seq;
+		uint64_t from = 0;
+		uint64_t to = 0;
+		std::optional<Stats::Side> side;
+	};
+
+	//Output pcap format, set by the first capture extracted into it, later records are rewritten to match
+	struct OutputFormat {
+		bool started = false;	//Global header written
+		bool swapped = false;
+		bool nanoseconds = false;
+		uint32_t snaplen = 0;
+		uint32_t linkType = 0;
+	};
+
+private:
+	struct Block {
+		uint64_t offset = 0;
+		uint32_t minSeq = UINT32_MAX;
+		uint32_t maxSeq = 0;
+		uint64_t minTs = UINT64_MAX;
+		uint64_t maxTs = 0;
+	};
+
+	std::vector<Block> blocks;
+	uint32_t interval;
+	uint32_t inBlock = 0;
+	uint64_t fileSize = 0;
+	bool valid = true;
+
+public:
+	SliceIndex(uint32_t interval = Slice_Index_Interval);
+
+	static std::string indexPath(const std::string& pcapPath) { return pcapPath + Slice_Index_Extension; }
+
+	/*
+	Index building, in file order
+	Inputs:
+			offset		-File offset of the record header, Pcap_Unknown_Offset disables the index
+			seq/ts_ns	-Parsed packet of the current record
+			size		-Capture file size once the pass is done
+	*/
+	void addRecord(uint64_t offset);
+	void addPacket(uint32_t seq, uint64_t ts_ns);
+	void finish(uint64_t size);
+
+	bool isValid() const;
+	size_t size() const;
+
+	/*
+	Save/load index file
+	Outputs:
+			true/false	-False on I/O error, bad file, or (load) index older than the capture
+	*/
+	bool save(const std::string& path) const;
+	bool load(const std::string& path, uint64_t expectedFileSize);
+
+	/*
+	Full pass over a capture to build its index, used when no index was saved
+	-Reads record headers directly, offsets never depend on the libpcap backend
+	Inputs:
+			pcapPath	-Capture file
+	Outputs:
+			true/false	-True if a valid index was built
+	*/
+	bool build(const std::string& pcapPath);
+
+	/*
+	Copy records matching query from a capture into an open output pcap
+	-Seeks straight to overlapping blocks
+	-Record headers are rewritten to the output's byte order and timestamp precision,
+	 snaplen in the output header grows to the largest record
+	Inputs:
+			pcapPath		-Capture file this index belongs to
+			query			-Seq/time range and side
+			out				-Output stream
+			format			-Output format, started by the first call with a fresh OutputFormat
+	Outputs:
+			optional<size_t>	-Records written, nullopt on read error or linktype not matching the output
+	*/
+	std::optional<size_t> extract(const std::string& pcapPath, const Query& query, std::ofstream& out, OutputFormat& format) const;
+};
@@ -1,7 +1,100 @@
 #include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <iterator>
+#include <vector>
 #include "Stats.h"
+#include "PcapFormat.h"
+
+namespace {
+	//Snapshot encoding helpers, all multi-byte values little-endian
+	void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(uint8_t(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(uint8_t(value));
+	}
+
+	//Snapshot order of the decode counters
+	std::array<uint64_t*, 12> decodeFields(PacketParser::DecodeCounters& counters) {
+		return { &counters.frames, &counters.decoded, &counters.vlanTags, &counters.mplsLabels, &counters.ipv4, &counters.ipv6,
+			&counters.gre, &counters.erspan, &counters.unsupported, &counters.truncated, &counters.notSampled, &counters.filtered };
+	}
+
+	uint64_t zigzag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+	int64_t unzigzag(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+	class SnapshotReader {
+	private:
+		const uint8_t* cursor;
+		const uint8_t* end;
+		bool ok = true;
+
+	public:
+		SnapshotReader(const std::vector<uint8_t>& data) : cursor(data.data()), end(data.data() + data.size()) {}
+
+		bool good() const { return ok; }
+		bool atEnd() const { return cursor == end; }
+
+		uint64_t getVarint() {
+			uint64_t value = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				if (cursor == end) break;
+				uint8_t byte = *cursor++;
+				value |= (uint64_t)(byte & 0x7F) << shift;
+				if (!(byte & 0x80)) return value;
+			}
+			ok = false;
+			return 0;
+		}
+
+		uint64_t getFixed(size_t bytes) {
+			if ((size_t)(end - cursor) < bytes) { ok = false; return 0; }
+			uint64_t value = PcapFormat::getFixed(cursor, bytes);
+			cursor += bytes;
+			return value;
+		}
+
+		bool getBytes(void* dst, size_t bytes) {
+			if ((size_t)(end - cursor) < bytes) return ok = false;
+			std::memcpy(dst, cursor, bytes);
+			cursor += bytes;
+			return true;
+		}
+	};
+
+	enum SnapshotFlags : uint8_t { HasA = 0x01, HasB = 0x02 };
+
+	//Histogram bucket for a gap: number of significant bits, clamped to last bucket
+	size_t gapBucket(uint64_t gap) {
+		size_t bits = 0;
+		for (size_t shift = 32; shift > 0; shift >>= 1) {
+			if (gap >> shift) { gap >>= shift; bits += shift; }
+		}
+		bits += (size_t)gap;
+		return std::min<size_t>(bits, Gap_Histogram_Buckets - 1);
+	}
+
+	//Upper bound (ns) of a gap histogram bucket
+	uint64_t gapBucketLimit(size_t bucket) { return (bucket >= 63) ? UINT64_MAX : (1ull << bucket); }
+
+	//Smallest bucket limit covering the given fraction of gaps
+	uint64_t gapPercentile(const std::array<uint64_t, Gap_Histogram_Buckets>& histogram, double fraction) {
+		uint64_t total = 0;
+		for (uint64_t count : histogram) total += count;
+		if (total == 0) return 0;
+
+		uint64_t target = (uint64_t)(fraction * total), seen = 0;
+		for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+			seen += histogram[bucket];
+			if (seen > target || seen == total) return gapBucketLimit(bucket);
+		}
+		return gapBucketLimit(histogram.size() - 1);
+	}
+}
 
 Stats::Stats() {
 	packetLog.reserve(packetLogSize);
@@ -10,62 +103,327 @@ Stats::Stats() {
 void Stats::add(Side side, uint32_t seq, uint64_t ts_ns) {
 	Entry& curEntry = packetLog[seq];
 	SideInfo& curSide = (side == Side::A) ? curEntry.A : curEntry.B;
+	updateFeedMetrics((side == Side::A) ? metricsA : metricsB, seq, ts_ns, curSide.count != 0);
 	curSide.earliest_ts = (curSide.count == 0) ? ts_ns : std::min(curSide.earliest_ts, ts_ns);
 	++curSide.count;
-	curSide.valid = true;
+
+	if (!curSide.valid) {
+		curSide.valid = true;
+		if (liveEnabled) updateLiveCounters(side, curEntry);
+	}
 
 	if (side == Side::A) ++totalA;
 	else ++totalB;
 }
 
-void Stats::generateStats() const {
-	uint64_t onlyA = 0, onlyB = 0;
-	uint64_t AFasterCount = 0, BFasterCount = 0;
-	double averageAdvA = 0.0, averageAdvB = 0.0;
-	uint64_t AFasterAdvSum = 0,  BFasterAdvSum = 0;
-	size_t matched = 0, ties = 0;
+void Stats::updateFeedMetrics(FeedMetrics& metrics, uint32_t seq, uint64_t ts_ns, bool duplicate) {
+	if (metrics.packets != 0) {
+		uint64_t gap = ts_ns > metrics.lastTs ? ts_ns - metrics.lastTs : 0;
+		++metrics.gapHistogram[gapBucket(gap)];
+		if (gap > metrics.maxGap) metrics.maxGap = gap;
+		metrics.gapSum += gap;
+
+		if (duplicate)
+			++metrics.duplicates;
+		else if (seq < metrics.highestSeq) {
+			++metrics.outOfOrder;
+			metrics.maxReorderDepth = std::max<uint64_t>(metrics.maxReorderDepth, metrics.highestSeq - seq);
+		}
+	}
+	metrics.highestSeq = std::max(metrics.highestSeq, seq);
+	metrics.lastTs = std::max(metrics.lastTs, ts_ns);
+	++metrics.packets;
+
+	metrics.burstShort.add(ts_ns);
+	metrics.burstLong.add(ts_ns);
+}
+
+const Stats::FeedMetrics& Stats::getFeedMetrics(Side side) const {
+	return (side == Side::A) ? metricsA : metricsB;
+}
+
+void Stats::updateLiveCounters(Side side, const Entry& entry) {
+	const SideInfo& other = (side == Side::A) ? entry.B : entry.A;
+	if (side == Side::A) ++live.uniquesA;
+	else ++live.uniquesB;
+	if (!other.valid) {
+		++live.uniques;
+		return;
+	}
+
+	++live.matched;
+	if (entry.A.earliest_ts < entry.B.earliest_ts) {
+		++live.AFasterCount;
+		live.AFasterAdvSum += entry.B.earliest_ts - entry.A.earliest_ts;
+	}
+	else if (entry.B.earliest_ts < entry.A.earliest_ts) {
+		++live.BFasterCount;
+		live.BFasterAdvSum += entry.A.earliest_ts - entry.B.earliest_ts;
+	}
+	else
+		++live.ties;
+}
+
+void Stats::enableLiveCounters() { liveEnabled = true; }
+
+const Stats::LiveCounters& Stats::getLiveCounters() const { return live; }
+
+size_t Stats::getTotal(Side side) const { return (side == Side::A) ? totalA : totalB; }
+
+Stats::Summary Stats::summarize() const {
+	Summary sum;
+	sum.uniques = packetLog.size();
+	sum.totalA = totalA;
+	sum.totalB = totalB;
 
 	for (auto& [seq, entry] : packetLog) {
 		if (entry.A.valid && !entry.B.valid) 
-			++onlyA;
+			++sum.onlyA;
 		else if (!entry.A.valid && entry.B.valid)
-			++onlyB;
+			++sum.onlyB;
 		else if (entry.A.valid && entry.B.valid) {
-			++matched;
+			++sum.matched;
 			if (entry.A.earliest_ts < entry.B.earliest_ts) {
-				++AFasterCount;
-				AFasterAdvSum += (entry.B.earliest_ts - entry.A.earliest_ts);
+				++sum.AFasterCount;
+				sum.AFasterAdvSum += (entry.B.earliest_ts - entry.A.earliest_ts);
 			}
 			else if (entry.B.earliest_ts < entry.A.earliest_ts) {
-				++BFasterCount;
-				BFasterAdvSum += (entry.A.earliest_ts - entry.B.earliest_ts);
+				++sum.BFasterCount;
+				sum.BFasterAdvSum += (entry.A.earliest_ts - entry.B.earliest_ts);
 			}
 			else
-				++ties;
+				++sum.ties;
 		}
 	}
-	averageAdvA = (AFasterCount == 0) ? 0.0 : AFasterAdvSum / AFasterCount;
-	averageAdvB = (BFasterCount == 0) ? 0.0 : BFasterAdvSum / BFasterCount;
+	return sum;
+}
+
+void Stats::generateStats() const {
+	Summary sum = summarize();
+	double averageAdvA = 0.0, averageAdvB = 0.0;
+	averageAdvA = (sum.AFasterCount == 0) ? 0.0 : sum.AFasterAdvSum / sum.AFasterCount;
+	averageAdvB = (sum.BFasterCount == 0) ? 0.0 : sum.BFasterAdvSum / sum.BFasterCount;
 
 	std::cout << "===== Feed Summary =====\n";
 	std::cout << std::left << std::setw(30) << "Channels:" << "A = " << static_cast<uint16_t>(Side::A) << std::endl;
 	std::cout << std::left << std::setw(30) << "" << "B = " << static_cast<uint16_t>(Side::B) << std::endl;
 
 	std::cout << std::endl;
-	std::cout << std::left << std::setw(30) << "Total unique seqs" << packetLog.size() << std::endl;
-	std::cout << std::left << std::setw(30) << "Total packets from A" << totalA << std::endl;
-	std::cout << std::left << std::setw(30) << "Total packets from B" << totalB << std::endl;
+	std::cout << std::left << std::setw(30) << "Total unique seqs" << sum.uniques << std::endl;
+	std::cout << std::left << std::setw(30) << "Total packets from A" << sum.totalA << std::endl;
+	std::cout << std::left << std::setw(30) << "Total packets from B" << sum.totalB << std::endl;
 
 	std::cout << std::endl;
-	std::cout << std::left << std::setw(30) << "Matched seqs" << matched << std::endl;
-	std::cout << std::left << std::setw(30) << "Only in A" << onlyA << std::endl;
-	std::cout << std::left << std::setw(30) << "Only in B" << onlyB << std::endl;
+	std::cout << std::left << std::setw(30) << "Matched seqs" << sum.matched << std::endl;
+	std::cout << std::left << std::setw(30) << "Only in A" << sum.onlyA << std::endl;
+	std::cout << std::left << std::setw(30) << "Only in B" << sum.onlyB << std::endl;
 
 	std::cout << std::endl;
-	std::cout << std::left << std::setw(30) << "A faster count" << AFasterCount << std::endl;
+	std::cout << std::left << std::setw(30) << "A faster count" << sum.AFasterCount << std::endl;
 	std::cout << std::left << std::setw(30) << "A avg speed advantage" << averageAdvA << " ns" << std::endl;
-	std::cout << std::left << std::setw(30) << "B faster count" << BFasterCount << std::endl;
+	std::cout << std::left << std::setw(30) << "B faster count" << sum.BFasterCount << std::endl;
 	std::cout << std::left << std::setw(30) << "B avg speed advantage" << averageAdvB << " ns" << std::endl;
-	std::cout << std::left << std::setw(30) << "Packets with same speed" << ties << std::endl;
+	std::cout << std::left << std::setw(30) << "Packets with same speed" << sum.ties << std::endl;
+
+	std::cout << std::endl;
+	printFeedMetrics("A", metricsA);
+	std::cout << std::endl;
+	printFeedMetrics("B", metricsB);
+}
+
+void Stats::printFeedMetrics(const char* name, const FeedMetrics& metrics) const {
+	std::string prefix = std::string(name) + " ";
+	//Shards can't see gaps, bursts or reorders across their boundaries
+	if (mergedSnapshots > 1) std::cout << "===== Feed " << name << " Timing (per-shard, approximate across shard boundaries) =====\n";
+	else std::cout << "===== Feed " << name << " Timing =====\n";
+	std::cout << std::left << std::setw(30) << prefix + "max pkts / 100us" << metrics.burstShort.maxCount << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "max pkts / 1ms" << metrics.burstLong.maxCount << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "gap p50 <" << gapPercentile(metrics.gapHistogram, 0.50) << " ns" << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "gap p99 <" << gapPercentile(metrics.gapHistogram, 0.99) << " ns" << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "gap max" << metrics.maxGap << " ns" << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "out of order" << metrics.outOfOrder << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "max reorder depth" << metrics.maxReorderDepth << std::endl;
+	std::cout << std::left << std::setw(30) << prefix + "duplicates" << metrics.duplicates << std::endl;
+
+	std::cout << prefix << "gap histogram:\n";
+	for (size_t bucket = 0; bucket < metrics.gapHistogram.size(); ++bucket) {
+		if (metrics.gapHistogram[bucket] == 0) continue;
+		std::cout << "  < " << std::left << std::setw(26) << (std::to_string(gapBucketLimit(bucket)) + " ns") << metrics.gapHistogram[bucket] << std::endl;
+	}
+}
+
+bool Stats::saveSnapshot(const std::string& path, const PacketParser::DecodeCounters* decode) const {
+	std::vector<uint32_t> seqs;
+	seqs.reserve(packetLog.size());
+	for (auto& [seq, entry] : packetLog) seqs.push_back(seq);
+	std::sort(seqs.begin(), seqs.end());
+
+	std::vector<uint8_t> out;
+	out.reserve(64 + packetLog.size() * 12); //rough, ~12 bytes per seq
+	out.insert(out.end(), Snapshot_Magic, Snapshot_Magic + Snapshot_Magic_Length);
+	PcapFormat::putFixed(out, Snapshot_Version, 4);
+	PcapFormat::putFixed(out, static_cast<uint16_t>(Side::A), 2);
+	PcapFormat::putFixed(out, static_cast<uint16_t>(Side::B), 2);
+	putVarint(out, totalA);
+	putVarint(out, totalB);
+	putVarint(out, seqs.size());
+
+	//Seq delta from previous seq, timestamps zigzag delta from previous timestamp
+	uint32_t prevSeq = 0;
+	uint64_t prevTs = 0;
+	for (uint32_t seq : seqs) {
+		const Entry& entry = packetLog.at(seq);
+		putVarint(out, seq - prevSeq);
+		prevSeq = seq;
+
+		uint8_t flags = (entry.A.valid ? HasA : 0) | (entry.B.valid ? HasB : 0);
+		out.push_back(flags);
+		for (const SideInfo* side : { &entry.A, &entry.B }) {
+			if (!side->valid) continue;
+			putVarint(out, zigzag((int64_t)(side->earliest_ts - prevTs)));
+			putVarint(out, side->count);
+			prevTs = side->earliest_ts;
+		}
+	}
+
+	for (const FeedMetrics* metrics : { &metricsA, &metricsB }) {
+		putVarint(out, metrics->packets);
+		putVarint(out, metrics->burstShort.maxCount);
+		putVarint(out, metrics->burstLong.maxCount);
+		putVarint(out, metrics->outOfOrder);
+		putVarint(out, metrics->maxReorderDepth);
+		putVarint(out, metrics->duplicates);
+		for (uint64_t count : metrics->gapHistogram) putVarint(out, count);
+	}
+
+	PacketParser::DecodeCounters counters = decode ? *decode : PacketParser::DecodeCounters{};
+	for (uint64_t* field : decodeFields(counters)) putVarint(out, *field);
+	for (const FeedMetrics* metrics : { &metricsA, &metricsB }) putVarint(out, metrics->maxGap);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		std::cerr << "Unable to write snapshot: " << path << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(out.data()), out.size());
+	if (!file) {
+		std::cerr << "Unable to write snapshot: " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool Stats::mergeSnapshot(const std::string& path, PacketParser::DecodeCounters* decode) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "Unable to open snapshot: " << path << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	SnapshotReader reader(data);
 
-}
\ No newline at end of file
+	char magic[Snapshot_Magic_Length];
+	if (!reader.getBytes(magic, sizeof(magic)) || std::memcmp(magic, Snapshot_Magic, sizeof(magic)) != 0) {
+		std::cerr << "Not a snapshot file: " << path << std::endl;
+		return false;
+	}
+	uint64_t version = reader.getFixed(4);
+	if (version < Snapshot_Min_Version || version > Snapshot_Version) {
+		std::cerr << "Unsupported snapshot version " << version << ": " << path << std::endl;
+		return false;
+	}
+	uint16_t portA = (uint16_t)reader.getFixed(2);
+	uint16_t portB = (uint16_t)reader.getFixed(2);
+	if (portA != static_cast<uint16_t>(Side::A) || portB != static_cast<uint16_t>(Side::B)) {
+		std::cerr << "Snapshot channels " << portA << "/" << portB << " do not match: " << path << std::endl;
+		return false;
+	}
+
+	//Decode fully before touching state so a corrupt file merges nothing
+	uint64_t snapTotalA = reader.getVarint();
+	uint64_t snapTotalB = reader.getVarint();
+	uint64_t entryCount = reader.getVarint();
+	if (!reader.good() || entryCount > data.size()) {
+		std::cerr << "Corrupt snapshot: " << path << std::endl;
+		return false;
+	}
+
+	std::vector<std::pair<uint32_t, Entry>> entries;
+	entries.reserve(entryCount);
+	uint32_t prevSeq = 0;
+	uint64_t prevTs = 0;
+	for (uint64_t i = 0; i < entryCount && reader.good(); ++i) {
+		std::pair<uint32_t, Entry> cur;
+		cur.first = prevSeq = prevSeq + (uint32_t)reader.getVarint();
+		uint8_t flags = (uint8_t)reader.getFixed(1);
+		cur.second.A.valid = flags & HasA;
+		cur.second.B.valid = flags & HasB;
+		for (SideInfo* side : { &cur.second.A, &cur.second.B }) {
+			if (!side->valid) continue;
+			side->earliest_ts = prevTs = prevTs + (uint64_t)unzigzag(reader.getVarint());
+			side->count = reader.getVarint();
+		}
+		entries.push_back(cur);
+	}
+
+	//Version 1 has no feed metrics
+	FeedMetrics snapMetrics[2];
+	if (version >= 2) {
+		for (FeedMetrics& metrics : snapMetrics) {
+			metrics.packets = reader.getVarint();
+			metrics.burstShort.maxCount = reader.getVarint();
+			metrics.burstLong.maxCount = reader.getVarint();
+			metrics.outOfOrder = reader.getVarint();
+			metrics.maxReorderDepth = reader.getVarint();
+			metrics.duplicates = reader.getVarint();
+			for (uint64_t& count : metrics.gapHistogram) count = reader.getVarint();
+		}
+	}
+
+	//Version 3 adds the shard's decode counters
+	PacketParser::DecodeCounters snapDecode;
+	if (version >= 3)
+		for (uint64_t* field : decodeFields(snapDecode)) *field = reader.getVarint();
+
+	//Version 4 adds the exact max gap per feed, older ones fall back to the top histogram bucket's bound
+	for (FeedMetrics& metrics : snapMetrics) {
+		if (version >= 4) metrics.maxGap = reader.getVarint();
+		else if (version >= 2) metrics.maxGap = gapPercentile(metrics.gapHistogram, 1.0);
+	}
+	if (!reader.good() || !reader.atEnd()) {
+		std::cerr << "Corrupt snapshot: " << path << std::endl;
+		return false;
+	}
+
+	for (auto& [seq, snapEntry] : entries) {
+		Entry& curEntry = packetLog[seq];
+		for (auto [curSide, snapSide] : { std::pair{ &curEntry.A, &snapEntry.A }, std::pair{ &curEntry.B, &snapEntry.B } }) {
+			if (!snapSide->valid) continue;
+			curSide->earliest_ts = curSide->valid ? std::min(curSide->earliest_ts, snapSide->earliest_ts) : snapSide->earliest_ts;
+			curSide->count += snapSide->count;
+			curSide->valid = true;
+		}
+	}
+	totalA += snapTotalA;
+	totalB += snapTotalB;
+
+	for (auto [metrics, snap] : { std::pair{ &metricsA, &snapMetrics[0] }, std::pair{ &metricsB, &snapMetrics[1] } }) {
+		metrics->packets += snap->packets;
+		metrics->burstShort.maxCount = std::max(metrics->burstShort.maxCount, snap->burstShort.maxCount);
+		metrics->burstLong.maxCount = std::max(metrics->burstLong.maxCount, snap->burstLong.maxCount);
+		metrics->outOfOrder += snap->outOfOrder;
+		metrics->maxReorderDepth = std::max(metrics->maxReorderDepth, snap->maxReorderDepth);
+		metrics->maxGap = std::max(metrics->maxGap, snap->maxGap);
+		metrics->duplicates += snap->duplicates;
+		for (size_t bucket = 0; bucket < metrics->gapHistogram.size(); ++bucket)
+			metrics->gapHistogram[bucket] += snap->gapHistogram[bucket];
+	}
+	++mergedSnapshots;
+
+	if (decode) {
+		if (version < 3) std::cerr << "Snapshot version " << version << " has no decode counters, Decode Summary is partial: " << path << std::endl;
+		*decode += snapDecode;
+	}
+
+	return true;
+}
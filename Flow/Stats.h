@@ -1,21 +1,36 @@
 #pragma once
+#include <array>
 #include <cstdint>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
 #include <optional>
+#include "PacketParser.h"
 
 #define packetLogSize 25000
+#define Snapshot_Magic "FLOWSNAP"
+#define Snapshot_Magic_Length 8
+#define Snapshot_Version 4
+#define Snapshot_Min_Version 1
+#define Burst_Window_Short_ns 100000
+#define Burst_Window_Long_ns 1000000
+#define Gap_Histogram_Buckets 64
 
 /*
 Aggregates sequence arbitration results between A/B feeds
 -Ingest packets from both sides, keyed by MsgSeqNum
 -For each side, track earliest timestamp and packet count
 -Compute uniques, matches, who was faster, and average speed advantage
+-Per feed, track microbursts, inter-arrival gaps and reordering inline
 
 Usage:
 -Call add(side, seq, ts_ns) for each parsed packet
 -Call generateStats()n once at the end to print a summary
+
+Sharded usage:
+-Each shard calls saveSnapshot(path) instead of generateStats()
+-Reducer calls mergeSnapshot(path) per shard, then generateStats()
 */
 class Stats {
 public:
@@ -26,6 +41,57 @@ public:
 		return std::nullopt;
 	}
 
+	/*
+	Max packets seen in any sliding window of windowNs
+	-Monotonic deque of timestamps, amortized O(1) per packet
+	-Timestamps going backwards are clamped to the newest one
+	*/
+	class BurstWindow {
+	private:
+		std::deque<uint64_t> window;
+		uint64_t windowNs;
+
+	public:
+		size_t maxCount = 0;
+
+		BurstWindow(uint64_t windowNs) : windowNs(windowNs) {}
+		void add(uint64_t ts_ns) {
+			if (!window.empty() && ts_ns < window.back()) ts_ns = window.back();
+			window.push_back(ts_ns);
+			while (window.front() + windowNs <= ts_ns) window.pop_front();
+			if (window.size() > maxCount) maxCount = window.size();
+		}
+	};
+
+	//Per feed arrival behaviour, computed without storing the stream
+	struct FeedMetrics {
+		BurstWindow burstShort{ Burst_Window_Short_ns };
+		BurstWindow burstLong{ Burst_Window_Long_ns };
+		std::array<uint64_t, Gap_Histogram_Buckets> gapHistogram{}; //Bucket k: gap < 2^k ns
+		uint64_t maxGap = 0;
+		uint64_t gapSum = 0;	//Live only (Prometheus histogram _sum), not in snapshots
+		uint64_t packets = 0;
+		uint64_t lastTs = 0;
+		uint32_t highestSeq = 0;
+		uint64_t outOfOrder = 0;	//Seq arrived after a higher seq
+		uint64_t maxReorderDepth = 0;
+		uint64_t duplicates = 0;	//Seq already seen on this feed
+	};
+
+	//Running outcome, kept up to date in add() once enableLiveCounters() is called
+	//Winner is decided when a seq first matches, a later earlier duplicate is only reflected by summarize()
+	struct LiveCounters {
+		uint64_t uniques = 0;
+		uint64_t uniquesA = 0;
+		uint64_t uniquesB = 0;
+		uint64_t matched = 0;
+		uint64_t AFasterCount = 0;
+		uint64_t BFasterCount = 0;
+		uint64_t AFasterAdvSum = 0;
+		uint64_t BFasterAdvSum = 0;
+		uint64_t ties = 0;
+	};
+
 private:
 	struct SideInfo {
 		bool valid = false;
@@ -41,8 +107,54 @@ private:
 	std::unordered_map<uint32_t, Entry> packetLog;
 	size_t totalA = 0;
 	size_t totalB = 0;
+	FeedMetrics metricsA;
+	FeedMetrics metricsB;
+	size_t mergedSnapshots = 0;
+	LiveCounters live;
+	bool liveEnabled = false;
+
+	/*
+	Helper function
+	Update per feed burst, gap and reorder metrics
+	Inputs:
+			metrics		-Feed to update
+			seq			-MsgSeqNum
+			ts_ns		-timestamp (nanoseconds)
+			duplicate	-True if seq was already seen on this feed
+	*/
+	void updateFeedMetrics(FeedMetrics& metrics, uint32_t seq, uint64_t ts_ns, bool duplicate);
+
+	/*
+	Helper function
+	Update live counters when a seq is first seen on a side
+	Inputs:
+			side	-Side just marked valid
+			entry	-Entry for the seq
+	*/
+	void updateLiveCounters(Side side, const Entry& entry);
+
+	/*
+	Helper function
+	Print burst, gap and reorder metrics for one feed
+	*/
+	void printFeedMetrics(const char* name, const FeedMetrics& metrics) const;
 
 public:
+	//Aggregated arbitration outcome, as printed by generateStats()
+	struct Summary {
+		size_t uniques = 0;
+		size_t totalA = 0;
+		size_t totalB = 0;
+		size_t matched = 0;
+		uint64_t onlyA = 0;
+		uint64_t onlyB = 0;
+		uint64_t AFasterCount = 0;
+		uint64_t BFasterCount = 0;
+		uint64_t AFasterAdvSum = 0;
+		uint64_t BFasterAdvSum = 0;
+		size_t ties = 0;
+	};
+
 	Stats();
 	~Stats() = default;
 
@@ -59,5 +171,46 @@ public:
 	Compute A and B arbitration statistics
 	-Walk every unique sequence and aggregate outcomes
 	*/
+	Summary summarize() const;
+
+	/*
+	Print A and B arbitration statistics
+	-Timing sections are labelled per-shard when built from more than one snapshot
+	*/
 	void generateStats() const;
+
+	const FeedMetrics& getFeedMetrics(Side side) const;
+	/*
+	Live monitoring, maintain LiveCounters in add()
+	-Call before the first add(), off by default so plain runs skip the work
+	*/
+	void enableLiveCounters();
+	const LiveCounters& getLiveCounters() const;
+	size_t getTotal(Side side) const;
+
+	/*
+	Write partial state (per-seq side info, totals, feed metrics, decode counters) to a binary snapshot
+	-Sequences sorted and delta encoded as varints
+	Inputs:
+			path		-Output file path
+			decode		-Shard's parser counters, nullptr writes zeros
+	Outputs:
+			true/false	-True if snapshot was written
+	*/
+	bool saveSnapshot(const std::string& path, const PacketParser::DecodeCounters* decode = nullptr) const;
+
+	/*
+	Merge a binary snapshot into this instance
+	-Per seq: earliest timestamp is min, counts are summed
+	-Merging every shard gives the same arbitration result as a single-process run
+	-Feed metrics: histograms/counters summed, burst, reorder and gap maxima take the max,
+	 bursts or reorders spanning two shards are not seen
+	-Decode counters summed into decode, version 1/2 snapshots have none (warned)
+	Inputs:
+			path		-Snapshot file path
+			decode		-Counters to add the shard's decode counters to, nullptr to skip
+	Outputs:
+			true/false	-False if file is unreadable, corrupt, or from another version/channel set
+	*/
+	bool mergeSnapshot(const std::string& path, PacketParser::DecodeCounters* decode = nullptr);
 };
\ No newline at end of file
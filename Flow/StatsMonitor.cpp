@@ -0,0 +1,239 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include "StatsMonitor.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace {
+	void copyFeed(MonitorFeed& out, const Stats::FeedMetrics& metrics) {
+		out.packets = metrics.packets;
+		out.burstShort = metrics.burstShort.maxCount;
+		out.burstLong = metrics.burstLong.maxCount;
+		out.outOfOrder = metrics.outOfOrder;
+		out.maxReorderDepth = metrics.maxReorderDepth;
+		out.duplicates = metrics.duplicates;
+		std::memcpy(out.gapHistogram, metrics.gapHistogram.data(), sizeof(out.gapHistogram));
+		out.gapSum = metrics.gapSum;
+	}
+
+	void renderFeed(const char* name, const MonitorFeed& feed) {
+		std::string prefix = std::string(name) + " ";
+		std::cout << std::left << std::setw(30) << prefix + "max pkts / 100us" << feed.burstShort << std::endl;
+		std::cout << std::left << std::setw(30) << prefix + "max pkts / 1ms" << feed.burstLong << std::endl;
+		std::cout << std::left << std::setw(30) << prefix + "out of order" << feed.outOfOrder << std::endl;
+		std::cout << std::left << std::setw(30) << prefix + "max reorder depth" << feed.maxReorderDepth << std::endl;
+		std::cout << std::left << std::setw(30) << prefix + "duplicates" << feed.duplicates << std::endl;
+	}
+
+	//One metric family, one sample per feed
+	void prometheusFamily(const char* family, const char* type, uint64_t valueA, uint64_t valueB) {
+		std::cout << "# TYPE " << family << " " << type << "\n";
+		std::cout << family << "{feed=\"A\"} " << valueA << "\n";
+		std::cout << family << "{feed=\"B\"} " << valueB << "\n";
+	}
+
+	//Bucket k holds gaps < 2^k ns, cumulative as Prometheus expects
+	void prometheusGapHistogram(const char* feedName, const MonitorFeed& feed) {
+		uint64_t cumulative = 0;
+		for (size_t bucket = 0; bucket < Gap_Histogram_Buckets - 1; ++bucket) {
+			cumulative += feed.gapHistogram[bucket];
+			std::cout << "flow_gap_ns_bucket{feed=\"" << feedName << "\",le=\"" << ((1ull << bucket) - 1) << "\"} " << cumulative << "\n";
+		}
+		cumulative += feed.gapHistogram[Gap_Histogram_Buckets - 1];
+		std::cout << "flow_gap_ns_bucket{feed=\"" << feedName << "\",le=\"+Inf\"} " << cumulative << "\n";
+		std::cout << "flow_gap_ns_sum{feed=\"" << feedName << "\"} " << feed.gapSum << "\n";
+		std::cout << "flow_gap_ns_count{feed=\"" << feedName << "\"} " << cumulative << "\n";
+	}
+}
+
+SharedSegment::SharedSegment(const std::string& segmentName, bool create) : owner(create) {
+#ifdef _WIN32
+	name = "Local\\" + segmentName;
+	if (create)
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(MonitorSegment), name.c_str());
+	else
+		mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	if (!mapping) return;
+
+	segment = static_cast<MonitorSegment*>(MapViewOfFile(mapping, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, sizeof(MonitorSegment)));
+#else
+	name = (segmentName.empty() || segmentName[0] != '/') ? "/" + segmentName : segmentName;
+	int fd = create ? shm_open(name.c_str(), O_CREAT | O_RDWR, 0644) : shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) return;
+	if (create && ftruncate(fd, sizeof(MonitorSegment)) != 0) {
+		close(fd);
+		return;
+	}
+
+	void* map = mmap(nullptr, sizeof(MonitorSegment), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) return;
+	segment = static_cast<MonitorSegment*>(map);
+#endif
+	if (!segment || !create) return;
+
+	//Fresh segment, magic written last so readers never see a half initialised header
+	std::memset(&segment->payload, 0, sizeof(segment->payload));
+	segment->version = Monitor_Version;
+	segment->portA = static_cast<uint16_t>(Stats::Side::A);
+	segment->portB = static_cast<uint16_t>(Stats::Side::B);
+	segment->sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	segment->magic = Monitor_Magic;
+}
+
+SharedSegment::~SharedSegment() {
+#ifdef _WIN32
+	if (segment) UnmapViewOfFile(segment);
+	if (mapping) CloseHandle(mapping);
+#else
+	if (segment) munmap(segment, sizeof(MonitorSegment));
+	if (owner && segment) shm_unlink(name.c_str()); //Attached readers keep their mapping
+#endif
+}
+
+StatsPublisher::StatsPublisher(const std::string& name) : shm(name, true) {}
+
+bool StatsPublisher::isValid() const { return shm.get() != nullptr; }
+
+void StatsPublisher::publish(const Stats& stats, const PacketParser::DecodeCounters& counters, bool finished) {
+	MonitorSegment* segment = shm.get();
+	if (!segment) return;
+
+	//Build off to the side, the odd window is then a single copy
+	MonitorPayload payload;
+	const Stats::LiveCounters& live = stats.getLiveCounters();
+	payload.publishCount = segment->payload.publishCount + 1;
+	payload.finished = finished ? 1 : 0;
+	payload.totalA = stats.getTotal(Stats::Side::A);
+	payload.totalB = stats.getTotal(Stats::Side::B);
+	payload.uniques = live.uniques;
+	payload.uniquesA = live.uniquesA;
+	payload.uniquesB = live.uniquesB;
+	payload.matched = live.matched;
+	payload.AFasterCount = live.AFasterCount;
+	payload.BFasterCount = live.BFasterCount;
+	payload.AFasterAdvSum = live.AFasterAdvSum;
+	payload.BFasterAdvSum = live.BFasterAdvSum;
+	payload.ties = live.ties;
+	copyFeed(payload.feedA, stats.getFeedMetrics(Stats::Side::A));
+	copyFeed(payload.feedB, stats.getFeedMetrics(Stats::Side::B));
+	payload.frames = counters.frames;
+	payload.decoded = counters.decoded;
+	payload.unsupported = counters.unsupported;
+	payload.truncated = counters.truncated;
+
+	uint64_t sequence = segment->sequence.load(std::memory_order_relaxed);
+	segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(&segment->payload, &payload, sizeof(payload));
+	segment->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+StatsMonitor::StatsMonitor(const std::string& name) : shm(name, false) {}
+
+bool StatsMonitor::isValid() const { return shm.get() != nullptr; }
+
+bool StatsMonitor::read(MonitorPayload& out) const {
+	const MonitorSegment* segment = shm.get();
+	if (!segment || segment->magic != Monitor_Magic || segment->version != Monitor_Version) return false;
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(Monitor_Read_Timeout_ms);
+	while (true) {
+		uint64_t before = segment->sequence.load(std::memory_order_acquire);
+		if (before & 1) {
+			if (std::chrono::steady_clock::now() > deadline) return false;
+			std::this_thread::yield(); //Writer mid-copy
+			continue;
+		}
+		std::memcpy(&out, &segment->payload, sizeof(out));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (segment->sequence.load(std::memory_order_relaxed) == before) return true;
+	}
+}
+
+uint16_t StatsMonitor::getPort(Stats::Side side) const {
+	const MonitorSegment* segment = shm.get();
+	if (!segment) return 0;
+	return (side == Stats::Side::A) ? segment->portA : segment->portB;
+}
+
+void StatsMonitor::render(const MonitorPayload& payload) const {
+	std::cout << "===== Live Feed Summary" << (payload.finished ? " (finished)" : "") << " =====\n";
+	std::cout << std::left << std::setw(30) << "Channels:" << "A = " << getPort(Stats::Side::A) << std::endl;
+	std::cout << std::left << std::setw(30) << "" << "B = " << getPort(Stats::Side::B) << std::endl;
+	std::cout << std::left << std::setw(30) << "Publishes" << payload.publishCount << std::endl;
+
+	std::cout << std::endl;
+	std::cout << std::left << std::setw(30) << "Total unique seqs" << payload.uniques << std::endl;
+	std::cout << std::left << std::setw(30) << "Total packets from A" << payload.totalA << std::endl;
+	std::cout << std::left << std::setw(30) << "Total packets from B" << payload.totalB << std::endl;
+
+	std::cout << std::endl;
+	std::cout << std::left << std::setw(30) << "Matched seqs" << payload.matched << std::endl;
+	std::cout << std::left << std::setw(30) << "Only in A" << payload.uniquesA - payload.matched << std::endl;
+	std::cout << std::left << std::setw(30) << "Only in B" << payload.uniquesB - payload.matched << std::endl;
+
+	std::cout << std::endl;
+	std::cout << std::left << std::setw(30) << "A faster count" << payload.AFasterCount << std::endl;
+	std::cout << std::left << std::setw(30) << "A avg speed advantage" << (payload.AFasterCount ? payload.AFasterAdvSum / payload.AFasterCount : 0) << " ns" << std::endl;
+	std::cout << std::left << std::setw(30) << "B faster count" << payload.BFasterCount << std::endl;
+	std::cout << std::left << std::setw(30) << "B avg speed advantage" << (payload.BFasterCount ? payload.BFasterAdvSum / payload.BFasterCount : 0) << " ns" << std::endl;
+	std::cout << std::left << std::setw(30) << "Packets with same speed" << payload.ties << std::endl;
+
+	std::cout << std::endl;
+	renderFeed("A", payload.feedA);
+	renderFeed("B", payload.feedB);
+
+	std::cout << std::endl;
+	std::cout << std::left << std::setw(30) << "Frames seen" << payload.frames << std::endl;
+	std::cout << std::left << std::setw(30) << "Frames decoded" << payload.decoded << std::endl;
+	std::cout << std::left << std::setw(30) << "Dropped unsupported" << payload.unsupported << std::endl;
+	std::cout << std::left << std::setw(30) << "Dropped truncated" << payload.truncated << std::endl;
+}
+
+void StatsMonitor::renderPrometheus(const MonitorPayload& payload) const {
+	std::cout << "# TYPE flow_publish_count counter\n";
+	std::cout << "flow_publish_count " << payload.publishCount << "\n";
+	std::cout << "# TYPE flow_finished gauge\n";
+	std::cout << "flow_finished " << payload.finished << "\n";
+	std::cout << "# TYPE flow_unique_seqs gauge\n";
+	std::cout << "flow_unique_seqs " << payload.uniques << "\n";
+	std::cout << "# TYPE flow_matched_seqs gauge\n";
+	std::cout << "flow_matched_seqs " << payload.matched << "\n";
+	std::cout << "# TYPE flow_ties gauge\n";
+	std::cout << "flow_ties " << payload.ties << "\n";
+
+	prometheusFamily("flow_packets_total", "counter", payload.totalA, payload.totalB);
+	prometheusFamily("flow_feed_unique_seqs", "gauge", payload.uniquesA, payload.uniquesB);
+	prometheusFamily("flow_faster", "gauge", payload.AFasterCount, payload.BFasterCount);
+	prometheusFamily("flow_advantage_ns_total", "counter", payload.AFasterAdvSum, payload.BFasterAdvSum); //_sum is reserved for histograms/summaries
+	std::cout << "# TYPE flow_burst_max_packets gauge\n";
+	std::cout << "flow_burst_max_packets{feed=\"A\",window=\"100us\"} " << payload.feedA.burstShort << "\n";
+	std::cout << "flow_burst_max_packets{feed=\"B\",window=\"100us\"} " << payload.feedB.burstShort << "\n";
+	std::cout << "flow_burst_max_packets{feed=\"A\",window=\"1ms\"} " << payload.feedA.burstLong << "\n";
+	std::cout << "flow_burst_max_packets{feed=\"B\",window=\"1ms\"} " << payload.feedB.burstLong << "\n";
+	prometheusFamily("flow_out_of_order_total", "counter", payload.feedA.outOfOrder, payload.feedB.outOfOrder);
+	prometheusFamily("flow_reorder_depth_max", "gauge", payload.feedA.maxReorderDepth, payload.feedB.maxReorderDepth);
+	prometheusFamily("flow_duplicates_total", "counter", payload.feedA.duplicates, payload.feedB.duplicates);
+	std::cout << "# TYPE flow_gap_ns histogram\n";
+	prometheusGapHistogram("A", payload.feedA);
+	prometheusGapHistogram("B", payload.feedB);
+
+	std::cout << "# TYPE flow_decode_frames_total counter\n";
+	std::cout << "flow_decode_frames_total " << payload.frames << "\n";
+	std::cout << "# TYPE flow_decode_decoded_total counter\n";
+	std::cout << "flow_decode_decoded_total " << payload.decoded << "\n";
+	std::cout << "# TYPE flow_decode_dropped_total counter\n";
+	std::cout << "flow_decode_dropped_total{reason=\"unsupported\"} " << payload.unsupported << "\n";
+	std::cout << "flow_decode_dropped_total{reason=\"truncated\"} " << payload.truncated << "\n";
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "PacketParser.h"
+#include "Stats.h"
+
+#define Monitor_Magic 0x314E4F4D574F4C46ull //"FLOWMON1"
+#define Monitor_Version 2
+#define Monitor_Publish_Interval 65536 //Packets between publishes
+#define Monitor_Default_Segment "flow_stats"
+#define Monitor_Read_Timeout_ms 1000 //Writer stuck mid-publish longer than this is dead
+#define Monitor_Stall_Timeout_s 30 //No new publish for this long, writer stalled or gone
+
+/*
+Live Stats snapshot layout in shared memory
+-Writer bumps sequence to odd, copies payload, bumps to even (seqlock)
+-Readers copy payload and retry if sequence was odd or changed, writer never waits
+*/
+struct MonitorFeed {
+	uint64_t packets;
+	uint64_t burstShort;
+	uint64_t burstLong;
+	uint64_t outOfOrder;
+	uint64_t maxReorderDepth;
+	uint64_t duplicates;
+	uint64_t gapHistogram[Gap_Histogram_Buckets];
+	uint64_t gapSum;
+};
+
+struct MonitorPayload {
+	uint64_t publishCount;
+	uint64_t finished;
+	uint64_t totalA;
+	uint64_t totalB;
+	uint64_t uniques;
+	uint64_t uniquesA;
+	uint64_t uniquesB;
+	uint64_t matched;
+	uint64_t AFasterCount;
+	uint64_t BFasterCount;
+	uint64_t AFasterAdvSum;
+	uint64_t BFasterAdvSum;
+	uint64_t ties;
+	MonitorFeed feedA;
+	MonitorFeed feedB;
+	uint64_t frames;
+	uint64_t decoded;
+	uint64_t unsupported;
+	uint64_t truncated;
+};
+
+struct MonitorSegment {
+	uint64_t magic;
+	uint32_t version;
+	uint16_t portA;
+	uint16_t portB;
+	std::atomic<uint64_t> sequence;
+	MonitorPayload payload;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Seqlock counter must be lock free to live in shared memory");
+
+/*
+Shared memory segment, POSIX shm on Linux, named file mapping on Windows
+*/
+class SharedSegment {
+private:
+	std::string name;
+	MonitorSegment* segment = nullptr;
+	bool owner = false;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+
+public:
+	/*
+	Create (owner) or attach to a segment
+	Inputs:
+			name	-Segment name
+			create	-True to create/reset it, false to attach read-only
+	*/
+	SharedSegment(const std::string& name, bool create);
+	~SharedSegment();
+	SharedSegment(const SharedSegment&) = delete; //We own the mapping
+	SharedSegment& operator=(const SharedSegment&) = delete;
+
+	MonitorSegment* get() const { return segment; }
+};
+
+/*
+Writer side, call tick() once per packet from the ingest loop
+-Copies Stats/PacketParser counters into the segment every Monitor_Publish_Interval packets
+-Stats must have enableLiveCounters() called before ingest
+*/
+class StatsPublisher {
+private:
+	SharedSegment shm;
+	uint32_t sincePublish = 0;
+
+public:
+	StatsPublisher(const std::string& name = Monitor_Default_Segment);
+	~StatsPublisher() = default;
+
+	bool isValid() const;
+
+	void tick(const Stats& stats, const PacketParser& parser) {
+		if (++sincePublish < Monitor_Publish_Interval) return;
+		sincePublish = 0;
+		publish(stats, parser.getCounters(), false);
+	}
+
+	/*
+	Publish now
+	Inputs:
+			stats		-Stats being built
+			counters	-Decode counters
+			finished	-True for the final publish
+	*/
+	void publish(const Stats& stats, const PacketParser::DecodeCounters& counters, bool finished);
+};
+
+/*
+Reader side
+*/
+class StatsMonitor {
+private:
+	SharedSegment shm;
+
+public:
+	StatsMonitor(const std::string& name = Monitor_Default_Segment);
+	~StatsMonitor() = default;
+
+	bool isValid() const;
+
+	/*
+	Take a consistent copy of the payload
+	Outputs:
+			out			-Payload copy
+			true/false	-False if segment is missing, not a Flow segment, or the writer
+						 stayed mid-publish for Monitor_Read_Timeout_ms (crashed in the copy)
+	*/
+	bool read(MonitorPayload& out) const;
+	uint16_t getPort(Stats::Side side) const;
+
+	/*
+	Render a payload as text, or as Prometheus exposition format
+	*/
+	void render(const MonitorPayload& payload) const;
+	void renderPrometheus(const MonitorPayload& payload) const;
+};
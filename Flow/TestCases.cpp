@@ -3,8 +3,20 @@
 #include <iostream>
 #include <pcap.h>
 #include "PacketParser.h"
+#include "PcapHandler.h"
 #include "Stats.h"
+#include "ApproxStats.h"
+#include "StatsMonitor.h"
+#include "SliceIndex.h"
+#include "PacketFilter.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <sstream>
 
 class TestCases {
 private:
@@ -36,19 +48,14 @@ private:
 		size_t failed = 0;
 	};
 
-	Packet makeBasicPacket(uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec, bool vlan = false, size_t ihlOptionsLength = 0) {
-		//Set arbitrary values
-		Packet out;
-		auto& packetData = out.data;
-		packetData.reserve(256); //arbitrary
-
-		//Ethernet
+	void appendEthernet(std::vector<uint8_t>& packetData, const std::vector<uint16_t>& tpids, uint16_t type) {
 		for (int i = 0; i < Ethernet_Dst_Length; ++i) packetData.push_back(0x01); //dst
 		for (int i = 0; i < Ethernet_Src_Length; ++i) packetData.push_back(0x02); //src
-		if (vlan) { be16(packetData, Ethernet_VLAN_TPID_Value); be16(packetData, 0x0001); be16(packetData, 0x0800); } //vlan + type
-		else { be16(packetData, 0x0800); } //type
+		for (uint16_t tpid : tpids) { be16(packetData, tpid); be16(packetData, 0x0001); } //vlan tags, outermost first
+		be16(packetData, type); //type
+	}
 
-		//IPv4
+	void appendIPv4(std::vector<uint8_t>& packetData, uint8_t protocol, size_t ihlOptionsLength = 0) {
 		uint8_t ihlVal = IPv4_Ver_IHL_Length
 			+ IPv4_DSCP_ECN_Length
 			+ IPv4_TotalLen_Length
@@ -60,18 +67,20 @@ private:
 			+ IPv4_Src_Length
 			+ IPv4_Dst_Length
 			+ ihlOptionsLength;
-		packetData.push_back(ihlVal * 8 / IpV4_IHL_Header_Size); //ver + ihl (0 options = 20 total length)
+		packetData.push_back(0x40 | (ihlVal * 8 / IpV4_IHL_Header_Size)); //ver + ihl (0 options = 20 total length)
 		packetData.push_back(0x00); //dscp + ecn
 		be16(packetData, ihlVal); //Total Length
 		be16(packetData, 0x1234); //id
 		be16(packetData, 0x0000); //Flags + fragment offset
 		packetData.push_back(32); //TTL
-		packetData.push_back(17); //Protocol
+		packetData.push_back(protocol); //Protocol
 		be16(packetData, 0);  //Checksum
 		be32(packetData, 0x00000001); //src
 		be32(packetData, 0x00000002); //dst
 		for (int i = 0; i < ihlOptionsLength; ++i) packetData.push_back(0x05);  //options
+	}
 
+	void appendUDPAndTrailer(std::vector<uint8_t>& packetData, uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec) {
 		//UDP
 		be16(packetData, 8010); //src port
 		be16(packetData, udpPort); //dst port = Side
@@ -84,14 +93,123 @@ private:
 		be32(packetData, trailerSec);		// byte 8-11 : seconds
 		be32(packetData, trailerNanoSec);	// byte 12-15 : nanoseconds
 		for (int i = 0; i < 4; ++i) packetData.push_back(0x02); // bytes 16-19
+	}
 
-		//packet header
-		out.hdr.caplen = out.hdr.len = static_cast<bpf_u_int32>(packetData.size());
+	void finishPacket(Packet& out) {
+		out.hdr.caplen = out.hdr.len = static_cast<bpf_u_int32>(out.data.size());
 		out.hdr.ts.tv_sec = out.hdr.ts.tv_usec = 0;
+	}
+
+	Packet makeBasicPacket(uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec, bool vlan = false, size_t ihlOptionsLength = 0) {
+		//Set arbitrary values
+		Packet out;
+		auto& packetData = out.data;
+		packetData.reserve(256); //arbitrary
+
+		if (vlan) appendEthernet(packetData, { Ethernet_VLAN_TPID_Value }, IPv4_type);
+		else appendEthernet(packetData, {}, IPv4_type);
+		appendIPv4(packetData, IPPROTO_UDP_Value, ihlOptionsLength);
+		appendUDPAndTrailer(packetData, udpPort, udpSeq, trailerSec, trailerNanoSec);
+
+		//packet header
+		finishPacket(out);
+		return out;
+	}
+
+	Packet makePacket_QinQ(uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec) {
+		Packet out;
+		appendEthernet(out.data, { Ethernet_QinQ_TPID_Value, Ethernet_VLAN_TPID_Value }, IPv4_type);
+		appendIPv4(out.data, IPPROTO_UDP_Value);
+		appendUDPAndTrailer(out.data, udpPort, udpSeq, trailerSec, trailerNanoSec);
+		finishPacket(out);
+		return out;
+	}
+
+	Packet makePacket_MPLS(uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec) {
+		Packet out;
+		appendEthernet(out.data, { Ethernet_VLAN_TPID_Value }, MPLS_Unicast_type);
+		be32(out.data, (1000u << 12) | 64);			//label 1000, ttl 64
+		be32(out.data, (2000u << 12) | 0x100 | 64);	//label 2000, bottom of stack
+		appendIPv4(out.data, IPPROTO_UDP_Value);
+		appendUDPAndTrailer(out.data, udpPort, udpSeq, trailerSec, trailerNanoSec);
+		finishPacket(out);
+		return out;
+	}
+
+	Packet makePacket_IPv6(uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec) {
+		Packet out;
+		auto& packetData = out.data;
+		appendEthernet(packetData, {}, IPv6_type);
+
+		//IPv6 + hop-by-hop extension header
+		be32(packetData, 0x60000000); //ver + traffic class + flow label
+		be16(packetData, 8 + 12); //payload length
+		packetData.push_back(IPPROTO_HopByHop_Value); //next header
+		packetData.push_back(64); //hop limit
+		for (int i = 0; i < 32; ++i) packetData.push_back(0x03); //src + dst
+		packetData.push_back(IPPROTO_UDP_Value); //ext next header
+		packetData.push_back(0); //ext length (8 bytes)
+		for (int i = 0; i < 6; ++i) packetData.push_back(0x00); //padding
 
+		appendUDPAndTrailer(packetData, udpPort, udpSeq, trailerSec, trailerNanoSec);
+		finishPacket(out);
 		return out;
 	}
 
+	Packet makePacket_ERSPAN(uint8_t version, uint16_t udpPort, uint32_t udpSeq, uint32_t trailerSec, uint32_t trailerNanoSec, bool subheader = false) {
+		Packet out;
+		auto& packetData = out.data;
+		appendEthernet(packetData, {}, IPv4_type);
+		appendIPv4(packetData, IPPROTO_GRE_Value);
+
+		//GRE with sequence number
+		be16(packetData, GRE_Sequence_Flag);
+		be16(packetData, version == 3 ? ERSPAN3_type : ERSPAN2_type);
+		be32(packetData, 7); //GRE seq
+
+		if (version == 3) {
+			be32(packetData, (ERSPAN3_Version << 28) | 0x05); //ver + vlan + session
+			be32(packetData, 0xAABBCCDD); //timestamp
+			be32(packetData, subheader ? ERSPAN3_Subheader_Flag : 0); //sgt + flags
+			if (subheader) for (int i = 0; i < ERSPAN3_Subheader_Length; ++i) packetData.push_back(0x04);
+		}
+		else {
+			be32(packetData, (ERSPAN2_Version << 28) | 0x05); //ver + vlan + session
+			be32(packetData, 0x00000000); //reserved + index
+		}
+
+		//Mirrored frame
+		Packet inner = makeBasicPacket(udpPort, udpSeq, trailerSec, trailerNanoSec, true);
+		packetData.insert(packetData.end(), inner.data.begin(), inner.data.end());
+		finishPacket(out);
+		return out;
+	}
+
+	Packet makePacket_TCP() {
+		Packet out;
+		appendEthernet(out.data, {}, IPv4_type);
+		appendIPv4(out.data, 6);
+		for (int i = 0; i < 40; ++i) out.data.push_back(0x00); //tcp header + payload
+		finishPacket(out);
+		return out;
+	}
+
+	Packet makePacket_ARP() {
+		Packet out;
+		appendEthernet(out.data, {}, 0x0806);
+		for (int i = 0; i < 28; ++i) out.data.push_back(0x00);
+		finishPacket(out);
+		return out;
+	}
+
+	bool parsesTo(Packet& curPacket, PacketParser& parser, uint16_t port, uint32_t seq, uint32_t sec, uint32_t nanoSec) {
+		if (!parser.parseBytes(&curPacket.hdr, curPacket.data.data())) return false;
+		if (parser.getPort() != port) return false;
+		if (parser.getSequence() != seq) return false;
+		uint64_t expectedTs = (uint64_t)nanoSec + (uint64_t)sec * 1e9;
+		return parser.getTimestamp() == expectedTs;
+	}
+
 	Packet makePacket_BadTrailer(uint16_t udpPort, uint32_t udpSeq) {
 		Packet out = makeBasicPacket(udpPort, udpSeq, 1, 2);
 		out.data.resize(out.data.size() - 10);
@@ -99,6 +217,30 @@ private:
 		return out;
 	}
 
+	//Write packets to a classic pcap file, little-endian microseconds by default
+	bool writePcapFile(const std::string& path, const std::vector<Packet>& packets, bool bigEndian = false, bool nanoseconds = false) {
+		std::vector<uint8_t> out;
+		auto put32 = [&](uint32_t value) { if (bigEndian) be32(out, value); else le32(out, value); };
+		auto put16 = [&](uint16_t value) { if (bigEndian) be16(out, value); else { out.push_back(uint8_t(value & 0xFF)); out.push_back(uint8_t(value >> 8)); } };
+		put32(nanoseconds ? Pcap_Magic_Nano : Pcap_Magic_Micro);
+		put16(2); //version 2.4
+		put16(4);
+		put32(0); //thiszone
+		put32(0); //sigfigs
+		put32(65535); //snaplen
+		put32(1); //linktype ethernet
+		for (const Packet& packet : packets) {
+			put32((uint32_t)packet.hdr.ts.tv_sec);
+			put32((uint32_t)packet.hdr.ts.tv_usec * (nanoseconds ? 1000 : 1));
+			put32(packet.hdr.caplen);
+			put32(packet.hdr.len);
+			out.insert(out.end(), packet.data.begin(), packet.data.end());
+		}
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(out.data()), out.size());
+		return file.good();
+	}
+
 	void TEST(const char* name, bool pass, Results& r) {
 		if (pass) { std::cout << "[PASS] " << name << std::endl; ++r.passed; }
 		else { std::cout << "[FAIL] " << name << std::endl; ++r.failed; }
@@ -187,6 +329,454 @@ public:
 		return true;
 	}
 
+	//Test QinQ stacked VLAN tags
+	bool Test7() {
+		Packet curPacket = makePacket_QinQ(15310, 42, 5, 6);
+		PacketParser parser;
+
+		if (!parsesTo(curPacket, parser, 15310, 42, 5, 6)) return false;
+		return parser.getCounters().vlanTags == 2;
+	}
+
+	//Test MPLS label stack inside VLAN
+	bool Test8() {
+		Packet curPacket = makePacket_MPLS(14310, 43, 5, 6);
+		PacketParser parser;
+
+		if (!parsesTo(curPacket, parser, 14310, 43, 5, 6)) return false;
+		return parser.getCounters().mplsLabels == 2 && parser.getCounters().vlanTags == 1;
+	}
+
+	//Test IPv6 UDP with extension header
+	bool Test9() {
+		Packet curPacket = makePacket_IPv6(14310, 44, 5, 6);
+		PacketParser parser;
+
+		if (!parsesTo(curPacket, parser, 14310, 44, 5, 6)) return false;
+		return parser.getCounters().ipv6 == 1;
+	}
+
+	//Test GRE/ERSPAN II and III (with and without subheader)
+	bool Test10() {
+		Packet erspan2 = makePacket_ERSPAN(2, 14310, 45, 5, 6);
+		Packet erspan3 = makePacket_ERSPAN(3, 15310, 46, 5, 7);
+		Packet erspan3Sub = makePacket_ERSPAN(3, 15310, 47, 5, 8, true);
+		PacketParser parser;
+
+		if (!parsesTo(erspan2, parser, 14310, 45, 5, 6)) return false;
+		if (!parsesTo(erspan3, parser, 15310, 46, 5, 7)) return false;
+		if (!parsesTo(erspan3Sub, parser, 15310, 47, 5, 8)) return false;
+		const PacketParser::DecodeCounters& counters = parser.getCounters();
+		return counters.gre == 3 && counters.erspan == 3 && counters.ipv4 == 6 && counters.decoded == 3;
+	}
+
+	//Test non-UDP and non-IP traffic is rejected and counted
+	bool Test11() {
+		Packet tcp = makePacket_TCP();
+		Packet arp = makePacket_ARP();
+		Packet truncated = makePacket_BadTrailer(14310, 1);
+		PacketParser parser;
+
+		//IPv6 extension header numbers are not IPv4 payloads
+		Packet ipv4Fragment;
+		appendEthernet(ipv4Fragment.data, {}, IPv4_type);
+		appendIPv4(ipv4Fragment.data, IPPROTO_Fragment_Value);
+		ipv4Fragment.data.push_back(IPPROTO_UDP_Value);
+		for (int i = 0; i < IPv6_Fragment_Header_Length - 1; ++i) ipv4Fragment.data.push_back(0x00);
+		appendUDPAndTrailer(ipv4Fragment.data, 14310, 1, 2, 3);
+		finishPacket(ipv4Fragment);
+
+		if (parser.parseBytes(&tcp.hdr, tcp.data.data())) return false;
+		if (parser.parseBytes(&arp.hdr, arp.data.data())) return false;
+		if (parser.parseBytes(&truncated.hdr, truncated.data.data())) return false;
+		if (parser.parseBytes(&ipv4Fragment.hdr, ipv4Fragment.data.data())) return false;
+		const PacketParser::DecodeCounters& counters = parser.getCounters();
+		return counters.frames == 4 && counters.unsupported == 3 && counters.truncated == 1 && counters.decoded == 0;
+	}
+
+	//Test sharded stats: merged snapshots match a single-process run
+	bool Test12() {
+		Stats full, shard1, shard2, merged;
+		std::string path1 = (std::filesystem::temp_directory_path() / "flow_test_shard1.snap").string();
+		std::string path2 = (std::filesystem::temp_directory_path() / "flow_test_shard2.snap").string();
+
+		for (uint32_t seq = 0; seq < 1000; ++seq) {
+			uint64_t ts = 1700000000000000000ull + seq * 1000;
+			Stats& shard = (seq % 3 == 0) ? shard1 : shard2;
+			if (seq % 7 != 0) { full.add(Stats::Side::A, seq, ts + seq % 11); shard.add(Stats::Side::A, seq, ts + seq % 11); }
+			if (seq % 5 != 0) { full.add(Stats::Side::B, seq, ts + seq % 13); shard2.add(Stats::Side::B, seq, ts + seq % 13); }
+		}
+		//Duplicate across shards, earliest wins
+		full.add(Stats::Side::A, 1, 5); shard1.add(Stats::Side::A, 1, 5);
+
+		PacketParser::DecodeCounters decode1, decode2, decodeMerged;
+		decode1.frames = 700; decode1.decoded = 690; decode1.truncated = 10; decode1.filtered = 3;
+		decode2.frames = 1300; decode2.decoded = 1280; decode2.unsupported = 20; decode2.vlanTags = 1280; decode2.erspan = 5;
+		if (!shard1.saveSnapshot(path1, &decode1) || !shard2.saveSnapshot(path2, &decode2)) return false;
+		if (!merged.mergeSnapshot(path1, &decodeMerged) || !merged.mergeSnapshot(path2, &decodeMerged)) return false;
+
+		Stats::Summary expected = full.summarize(), actual = merged.summarize();
+		bool same = expected.uniques == actual.uniques && expected.totalA == actual.totalA && expected.totalB == actual.totalB
+			&& expected.matched == actual.matched && expected.onlyA == actual.onlyA && expected.onlyB == actual.onlyB
+			&& expected.AFasterCount == actual.AFasterCount && expected.BFasterCount == actual.BFasterCount
+			&& expected.AFasterAdvSum == actual.AFasterAdvSum && expected.BFasterAdvSum == actual.BFasterAdvSum
+			&& expected.ties == actual.ties;
+		same = same && decodeMerged.frames == 2000 && decodeMerged.decoded == 1970 && decodeMerged.truncated == 10 && decodeMerged.filtered == 3
+			&& decodeMerged.unsupported == 20 && decodeMerged.vlanTags == 1280 && decodeMerged.erspan == 5 && decodeMerged.ipv4 == 0;
+
+		//Version 2 snapshot (no decode counters) still merges
+		{
+			Stats old;
+			old.add(Stats::Side::A, 7, 100);
+			std::string pathOld = (std::filesystem::temp_directory_path() / "flow_test_shard_v2.snap").string();
+			if (!old.saveSnapshot(pathOld)) return false;
+			std::filesystem::resize_file(pathOld, std::filesystem::file_size(pathOld) - 14); //12 decode counters, 2 max gaps, all zero varints
+			{
+				std::fstream file(pathOld, std::ios::binary | std::ios::in | std::ios::out);
+				file.seekp(Snapshot_Magic_Length);
+				file.put(2);
+			}
+			Stats oldMerged;
+			PacketParser::DecodeCounters oldDecode;
+			same = same && oldMerged.mergeSnapshot(pathOld, &oldDecode) && oldMerged.summarize().uniques == 1 && oldDecode.frames == 0;
+			std::filesystem::remove(pathOld);
+		}
+
+		//Merged timing sections say they are per-shard
+		std::ostringstream report;
+		std::streambuf* previous = std::cout.rdbuf(report.rdbuf());
+		merged.generateStats();
+		std::cout.rdbuf(previous);
+		same = same && report.str().find("Timing (per-shard, approximate across shard boundaries)") != std::string::npos;
+
+		//Truncated snapshot must be rejected
+		std::filesystem::resize_file(path2, std::filesystem::file_size(path2) - 3);
+		Stats rejected;
+		bool corruptRejected = !rejected.mergeSnapshot(path2) && rejected.summarize().uniques == 0;
+
+		std::filesystem::remove(path1);
+		std::filesystem::remove(path2);
+		return same && corruptRejected;
+	}
+
+	//Test per feed burst, gap and reorder metrics, and that they survive a snapshot
+	bool Test13() {
+		Stats stats;
+		for (uint32_t seq = 1; seq <= 10; ++seq) stats.add(Stats::Side::A, seq, 1000 * seq); //10 pkts, 1us apart
+		stats.add(Stats::Side::A, 100, 10000000);	//Gap to 10ms
+		stats.add(Stats::Side::A, 5, 10000001);		//Duplicate
+		stats.add(Stats::Side::A, 50, 10000002);	//Out of order by 50
+		stats.add(Stats::Side::B, 1, 1000);
+
+		const Stats::FeedMetrics& a = stats.getFeedMetrics(Stats::Side::A);
+		bool ok = a.burstShort.maxCount == 10 && a.burstLong.maxCount == 10
+			&& a.gapHistogram[10] == 9		//1000ns < 1024
+			&& a.gapHistogram[24] == 1		//~10ms < 2^24
+			&& a.gapHistogram[1] == 2		//1ns gaps
+			&& a.maxGap == 9990000
+			&& a.duplicates == 1 && a.outOfOrder == 1 && a.maxReorderDepth == 50
+			&& stats.getFeedMetrics(Stats::Side::B).packets == 1;
+
+		std::string path = (std::filesystem::temp_directory_path() / "flow_test_metrics.snap").string();
+		Stats merged;
+		if (!stats.saveSnapshot(path) || !merged.mergeSnapshot(path)) return false;
+		std::filesystem::remove(path);
+
+		const Stats::FeedMetrics& m = merged.getFeedMetrics(Stats::Side::A);
+		return ok && m.gapHistogram == a.gapHistogram && m.maxGap == a.maxGap && m.burstShort.maxCount == 10
+			&& m.duplicates == 1 && m.outOfOrder == 1 && m.maxReorderDepth == 50;
+	}
+
+	//Test pcap reading, small io_uring blocks so records straddle block boundaries
+	bool Test14() {
+		std::string path = (std::filesystem::temp_directory_path() / "flow_test_reader.pcap").string();
+		std::vector<Packet> packets;
+		for (uint32_t seq = 0; seq < 500; ++seq) {
+			packets.push_back(makeBasicPacket(14310, seq, 1, seq, seq % 2 == 0, (seq % 3) * 4));
+			packets.back().hdr.ts.tv_usec = seq;
+		}
+		if (!writePcapFile(path, packets)) return false;
+
+		auto readsBack = [&](auto& reader, auto success) {
+			PacketParser parser;
+			uint32_t expected = 0;
+			uint64_t offset = Pcap_Global_Header_Length;
+			while (reader.getNextPacket() == success) {
+				if (!parser.parseBytes(reader.getHeader(), reader.getData())) return false;
+				if (parser.getSequence() != expected || reader.getHeader()->ts.tv_usec != expected) return false;
+				if (reader.getRecordOffset() != offset) return false;
+				offset += Pcap_Record_Header_Length + packets[expected].data.size();
+				++expected;
+			}
+			return expected == packets.size();
+		};
+
+		PcapHandler handler(path.c_str());
+		PcapHandler fallback(path.c_str(), 0); //libpcap
+		bool ok = handler.isValid() && readsBack(handler, PcapHandler::NextResult::Success);
+		ok = ok && fallback.isValid() && readsBack(fallback, PcapHandler::NextResult::Success);
+
+		//Snaplen below the records, libpcap cuts caplen so offsets after the first are unknown
+		{
+			std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+			const char snaplen[4] = { 40, 0, 0, 0 };
+			file.seekp(16);
+			file.write(snaplen, sizeof(snaplen));
+		}
+		PcapHandler truncated(path.c_str(), 0);
+		ok = ok && truncated.isValid() && truncated.getNextPacket() == PcapHandler::NextResult::Success && truncated.getRecordOffset() == Pcap_Global_Header_Length
+			&& truncated.getNextPacket() == PcapHandler::NextResult::Success && truncated.getRecordOffset() == Pcap_Unknown_Offset;
+#ifdef FLOW_HAVE_URING
+		//io_uring may be disabled at runtime (io_uring_disabled, seccomp), handler above already read through the fallback
+		UringReader reader(path.c_str(), 4, Uring_Block_Alignment);
+		if (reader.isValid()) ok = ok && readsBack(reader, UringReader::Status::Packet);
+#endif
+		std::filesystem::remove(path);
+		return ok;
+	}
+
+	//Test approximate mode: estimates land within their stated bounds
+	bool Test15() {
+		const uint32_t sampleRate = 16;
+		ApproxStats approx(sampleRate);
+		ApproxStats uncapped(64, SIZE_MAX);
+		Stats exact;
+		std::vector<uint64_t> advantagesA, advantagesB;
+		for (uint32_t seq = 0; seq < 200000; ++seq) {
+			uint64_t ts = 1000000 + (uint64_t)seq * 1000;
+			uint64_t tsA = ts + 300, tsB = ts + (uint64_t)seq * seq % 997;
+			bool hasA = seq % 10 != 0, hasB = seq % 7 != 0;
+			if (hasA) { approx.add(Stats::Side::A, seq, tsA); uncapped.add(Stats::Side::A, seq, tsA); exact.add(Stats::Side::A, seq, tsA); }
+			if (hasB) { approx.add(Stats::Side::B, seq, tsB); uncapped.add(Stats::Side::B, seq, tsB); exact.add(Stats::Side::B, seq, tsB); }
+			if (hasA && hasB && tsA < tsB) advantagesA.push_back(tsB - tsA);
+			if (hasA && hasB && tsB < tsA) advantagesB.push_back(tsA - tsB);
+		}
+		std::sort(advantagesA.begin(), advantagesA.end());
+		std::sort(advantagesB.begin(), advantagesB.end());
+
+		ApproxStats::Summary estimate = approx.summarize();
+		Stats::Summary actual = exact.summarize();
+		auto within = [](const ApproxStats::Estimate& e, double truth) { return e.bounded && std::abs(e.value - truth) <= e.bound; };
+		auto quantile = [](const std::vector<uint64_t>& sorted, double q) { return (double)sorted[(size_t)(q * (sorted.size() - 1))]; };
+
+		bool ok = within(estimate.uniques, (double)actual.uniques)
+			&& within(estimate.totalA, (double)actual.totalA) && within(estimate.totalB, (double)actual.totalB)
+			&& within(estimate.matched, (double)actual.matched)
+			&& within(estimate.onlyA, (double)actual.onlyA) && within(estimate.onlyB, (double)actual.onlyB)
+			&& within(estimate.AFasterCount, (double)actual.AFasterCount) && within(estimate.BFasterCount, (double)actual.BFasterCount)
+			&& within(estimate.AFasterAdvAvg, (double)actual.AFasterAdvSum / actual.AFasterCount)
+			&& within(estimate.BFasterAdvAvg, (double)actual.BFasterAdvSum / actual.BFasterCount)
+			&& within(estimate.AFasterAdvP50, quantile(advantagesA, 0.50)) && within(estimate.AFasterAdvP99, quantile(advantagesA, 0.99))
+			&& within(estimate.BFasterAdvP50, quantile(advantagesB, 0.50)) && within(estimate.BFasterAdvP99, quantile(advantagesB, 0.99))
+			&& within(estimate.ties, (double)actual.ties);
+		if (!ok) return false;
+
+		//~12500 seqs at 1/16 overflow the log: rate raised to 1/64, same sample as starting there
+		ApproxStats::Summary reference = uncapped.summarize();
+		if (estimate.sampledSeqs > Approx_Max_Sampled_Seqs || estimate.sampleRate != 64 || approx.getSampleRate() != 64) return false;
+		if (estimate.sampledSeqs != reference.sampledSeqs || estimate.matched.value != reference.matched.value
+			|| estimate.AFasterAdvP99.value != reference.AFasterAdvP99.value) return false;
+
+		//Too few samples for a p99 is reported as unbounded, not +/- 0
+		ApproxStats sparse(sampleRate);
+		for (uint32_t seq = 0; seq < 2000; ++seq) { sparse.add(Stats::Side::A, seq, 10); sparse.add(Stats::Side::B, seq, 20 + seq); }
+		if (sparse.summarize().AFasterAdvP99.bounded) return false;
+
+		//HyperLogLog alone
+		HyperLogLog hll;
+		for (uint32_t seq = 0; seq < 200000; ++seq) hll.add(SeqSample::hash(seq));
+		if (std::abs(hll.estimate() - 200000) / 200000 > Approx_Confidence_Z * HyperLogLog::relativeError()) return false;
+
+		//Parser sampling skips the trailer of non-sampled seqs only
+		PacketParser parser;
+		parser.setSampleRate(sampleRate);
+		size_t sampled = 0;
+		for (uint32_t seq = 0; seq < 1000; ++seq) {
+			Packet curPacket = makeBasicPacket(14310, seq, 2, 3);
+			if (!parser.parseBytes(&curPacket.hdr, curPacket.data.data()) || parser.getSequence() != seq) return false;
+			bool expectSampled = SeqSample::isSampled(SeqSample::hash(seq), sampleRate);
+			if ((parser.getTimestamp() != 0) != expectSampled) return false;
+			sampled += expectSampled;
+		}
+		return parser.getCounters().notSampled == 1000 - sampled;
+	}
+
+	//Test live shared memory stats: reader never sees a torn snapshot while writer publishes
+	bool Test16() {
+		StatsPublisher publisher("flow_test_monitor");
+		StatsMonitor monitor("flow_test_monitor");
+		if (!publisher.isValid() || !monitor.isValid()) return false;
+
+		Stats stats;
+		stats.enableLiveCounters();
+		PacketParser parser;
+		std::atomic<bool> done{ false };
+		std::thread writer([&]() {
+			for (uint32_t seq = 0; seq < 20000; ++seq) {
+				stats.add(Stats::Side::A, seq, seq * 10);
+				stats.add(Stats::Side::B, seq, seq * 10 + 5);
+				publisher.publish(stats, parser.getCounters(), seq == 19999);
+			}
+			done = true;
+		});
+
+		//Every field of a consistent snapshot agrees with the others
+		bool consistent = true;
+		MonitorPayload payload{};
+		while (!done || !payload.finished) {
+			if (!monitor.read(payload)) { consistent = false; break; }
+			if (payload.totalA != payload.feedA.packets || payload.matched != payload.AFasterCount
+				|| payload.AFasterAdvSum != payload.AFasterCount * 5 || payload.uniques != payload.uniquesA) {
+				consistent = false;
+				break;
+			}
+		}
+		writer.join();
+
+		if (!consistent || payload.finished != 1 || payload.matched != 20000 || payload.publishCount != 20000) return false;
+
+		//Gap histogram carries its _sum, advantage totals are a counter not a reserved _sum
+		std::ostringstream exposition;
+		std::streambuf* previous = std::cout.rdbuf(exposition.rdbuf());
+		monitor.renderPrometheus(payload);
+		std::cout.rdbuf(previous);
+		if (payload.feedA.gapSum != 19999 * 10 || exposition.str().find("flow_gap_ns_sum{feed=\"A\"} 199990\n") == std::string::npos
+			|| exposition.str().find("# TYPE flow_advantage_ns_total counter\n") == std::string::npos
+			|| exposition.str().find("flow_advantage_ns_sum") != std::string::npos) return false;
+
+		//Writer died mid-publish, reader gives up instead of spinning
+		SharedSegment stuck("flow_test_monitor_stuck", true);
+		StatsMonitor stuckMonitor("flow_test_monitor_stuck");
+		if (!stuck.get() || !stuckMonitor.isValid()) return false;
+		stuck.get()->sequence.store(1, std::memory_order_release);
+		return !stuckMonitor.read(payload);
+	}
+
+	//Test slice index: seq and time ranges pulled back out match a full scan
+	bool Test17() {
+		std::string path = (std::filesystem::temp_directory_path() / "flow_test_slice.pcap").string();
+		std::string outPath = (std::filesystem::temp_directory_path() / "flow_test_slice_out.pcap").string();
+		std::vector<Packet> packets;
+		for (uint32_t i = 0; i < 2000; ++i) packets.push_back(makeBasicPacket(i % 2 ? 15310 : 14310, i / 2, 1, i * 1000, i % 3 == 0));
+		packets.push_back(makeBasicPacket(9999, 0, 1, 0)); //Neither feed, never extracted
+		if (!writePcapFile(path, packets)) return false;
+
+		SliceIndex built(64);
+		SliceIndex loaded;
+		bool ok = built.build(path) && built.size() == (packets.size() + 63) / 64
+			&& built.save(SliceIndex::indexPath(path)) && loaded.load(SliceIndex::indexPath(path), std::filesystem::file_size(path))
+			&& !SliceIndex().load(SliceIndex::indexPath(path), std::filesystem::file_size(path) + 1);
+
+		//Records written, each checked against the expected side and key range
+		auto extracts = [&](const SliceIndex::Query& query, size_t expected) {
+			std::optional<size_t> written;
+			{
+				std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+				SliceIndex::OutputFormat format;
+				written = loaded.extract(path, query, out, format);
+			}
+			if (written != expected) return false;
+
+			PcapHandler reader(outPath.c_str());
+			PacketParser parser;
+			size_t count = 0;
+			while (reader.isValid() && reader.getNextPacket() == PcapHandler::NextResult::Success) {
+				if (!parser.parseBytes(reader.getHeader(), reader.getData())) return false;
+				uint64_t key = (query.key == SliceIndex::Key::Seq) ? parser.getSequence() : parser.getTimestamp();
+				if (key < query.from || key > query.to) return false;
+				if (query.side && parser.getPort() != (uint16_t)*query.side) return false;
+				++count;
+			}
+			return count == expected;
+		};
+
+		ok = ok && extracts({ SliceIndex::Key::Seq, 500, 599, Stats::Side::A }, 100);
+		ok = ok && extracts({ SliceIndex::Key::Seq, 990, 5000, std::nullopt }, 20);
+		ok = ok && extracts({ SliceIndex::Key::Time, 1000100000, 1000199999, std::nullopt }, 100);
+		ok = ok && extracts({ SliceIndex::Key::Time, 1000100000, 1000199999, Stats::Side::B }, 50);
+
+		//Little-endian us, big-endian us and nanosecond captures into one output, record headers rewritten to the first
+		std::vector<std::pair<std::string, std::pair<bool, bool>>> captures = {
+			{ "flow_test_slice_le.pcap", { false, false } }, { "flow_test_slice_be.pcap", { true, false } }, { "flow_test_slice_ns.pcap", { false, true } } };
+		std::vector<Packet> timed;
+		for (uint32_t seq = 0; seq < 300; ++seq) {
+			timed.push_back(makeBasicPacket(14310, seq, 1, seq));
+			timed.back().hdr.ts.tv_sec = 1700000000;
+			timed.back().hdr.ts.tv_usec = seq;
+		}
+		{
+			std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+			SliceIndex::OutputFormat format;
+			for (auto& [name, encoding] : captures) {
+				name = (std::filesystem::temp_directory_path() / name).string();
+				SliceIndex index(16);
+				std::optional<size_t> written;
+				ok = ok && writePcapFile(name, timed, encoding.first, encoding.second) && index.build(name)
+					&& (written = index.extract(name, { SliceIndex::Key::Seq, 100, 199, std::nullopt }, out, format)) && *written == 100;
+			}
+
+			//Another linktype can't be rewritten, rejected
+			std::vector<uint8_t> raw;
+			{
+				std::ifstream in(captures[0].first, std::ios::binary);
+				raw.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+			}
+			raw[20] = 113; //Linux cooked
+			std::string cooked = (std::filesystem::temp_directory_path() / "flow_test_slice_sll.pcap").string();
+			std::ofstream(cooked, std::ios::binary).write(reinterpret_cast<const char*>(raw.data()), raw.size());
+			SliceIndex index(16);
+			ok = ok && index.build(cooked) && !index.extract(cooked, { SliceIndex::Key::Seq, 100, 199, std::nullopt }, out, format);
+			std::filesystem::remove(cooked);
+		}
+
+		for (unsigned queueDepth : { (unsigned)Uring_Default_Queue_Depth, 0u }) {
+			PcapHandler reader(outPath.c_str(), queueDepth);
+			PacketParser parser;
+			size_t count = 0;
+			while (reader.isValid() && reader.getNextPacket() == PcapHandler::NextResult::Success) {
+				if (!parser.parseBytes(reader.getHeader(), reader.getData())) return false;
+				uint32_t seq = parser.getSequence();
+				if (seq < 100 || seq > 199 || reader.getHeader()->ts.tv_sec != 1700000000 || reader.getHeader()->ts.tv_usec != (long)seq) return false;
+				++count;
+			}
+			ok = ok && count == 300;
+		}
+
+		for (auto& [name, encoding] : captures) std::filesystem::remove(name);
+		std::filesystem::remove(path);
+		std::filesystem::remove(SliceIndex::indexPath(path));
+		std::filesystem::remove(outPath);
+		return ok;
+	}
+
+	//Test pre-parse filter: drops what can't be A/B, keeps anything the decoder might still reach
+	bool Test18() {
+		PacketFilter filter = PacketFilter::forSides();
+		auto accepts = [&](const Packet& packet) { return filter.accept(&packet.hdr, packet.data.data()); };
+
+		if (!accepts(makeBasicPacket(14310, 1, 2, 3)) || !accepts(makeBasicPacket(15310, 1, 2, 3, true))) return false;
+		if (!accepts(makeBasicPacket(14310, 1, 2, 3, false, 8)) || !accepts(makeBasicPacket(15310, 1, 2, 3, true, 12))) return false;
+		if (accepts(makeBasicPacket(9999, 1, 2, 3)) || accepts(makeBasicPacket(9999, 1, 2, 3, true, 4))) return false;
+		if (accepts(makePacket_TCP()) || accepts(makePacket_ARP())) return false;
+		if (!accepts(makePacket_QinQ(9999, 1, 2, 3)) || !accepts(makePacket_MPLS(9999, 1, 2, 3))) return false;
+		if (!accepts(makePacket_IPv6(9999, 1, 2, 3)) || !accepts(makePacket_ERSPAN(3, 9999, 1, 2, 3))) return false;
+
+		//Filtered frames never reach the decoder, A/B packets are unaffected
+		PacketParser parser;
+		parser.setFilter(&filter);
+		std::vector<Packet> packets = { makeBasicPacket(14310, 7, 2, 3), makeBasicPacket(9999, 8, 2, 3), makePacket_TCP(), makePacket_ARP(), makePacket_QinQ(15310, 9, 2, 3) };
+		size_t parsed = 0;
+		for (const Packet& packet : packets) parsed += parser.parseBytes(&packet.hdr, packet.data.data());
+		const PacketParser::DecodeCounters& counters = parser.getCounters();
+		if (parsed != 2 || counters.filtered != 3 || counters.unsupported != 0 || counters.decoded != 2) return false;
+
+		std::string expression = filter.bpfExpression();
+		return expression.find("udp dst port 14310 or udp dst port 15310") != std::string::npos
+			&& expression.find(") or (vlan and (") != std::string::npos
+			&& expression.find("ether proto 0x0800") == std::string::npos
+			&& expression.find("ip proto 44") == std::string::npos;
+	}
+
 	int runAll() {
 		Results r;
 		TEST("Basic parser without VLAN", Test1(), r);
@@ -195,6 +785,18 @@ public:
 		TEST("Basic parser without VLAN with IHL options", Test4(), r);
 		TEST("Basic parser with truncated trailer", Test5(), r);
 		TEST("Basic parser with stats", Test6(), r);
+		TEST("Parser with QinQ", Test7(), r);
+		TEST("Parser with MPLS", Test8(), r);
+		TEST("Parser with IPv6", Test9(), r);
+		TEST("Parser with GRE/ERSPAN", Test10(), r);
+		TEST("Parser drop counters", Test11(), r);
+		TEST("Stats snapshot merge", Test12(), r);
+		TEST("Stats feed burst/gap/reorder metrics", Test13(), r);
+		TEST("Pcap reader across block boundaries", Test14(), r);
+		TEST("Approximate stats", Test15(), r);
+		TEST("Live stats shared memory seqlock", Test16(), r);
+		TEST("Slice index extraction", Test17(), r);
+		TEST("Pre-parse packet filter", Test18(), r);
 
 		std::cout << std::endl;
 		std::cout << "Summary: " << r.passed << " passed, " << r.failed << " failed" << std::endl;
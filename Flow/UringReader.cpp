@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include "UringReader.h"
+
+#ifdef FLOW_HAVE_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+UringReader::UringReader(const char* filename, unsigned queueDepth, size_t blockSize) : blockSize(blockSize), depth(queueDepth) {
+#ifdef FLOW_HAVE_URING
+	if (depth == 0 || blockSize == 0 || blockSize % Uring_Block_Alignment != 0) return;
+
+	//O_DIRECT keeps archive reads out of the page cache, not every filesystem allows it
+	if ((fd = open(filename, O_RDONLY | O_DIRECT)) < 0 && (fd = open(filename, O_RDONLY)) < 0) return;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) { release(); return; }
+	fileSize = (uint64_t)st.st_size;
+	totalBlocks = (fileSize + blockSize - 1) / blockSize;
+
+	for (unsigned i = 0; i < depth; ++i) {
+		void* buffer = nullptr;
+		if (posix_memalign(&buffer, Uring_Block_Alignment, blockSize) != 0) { release(); return; }
+		buffers.push_back(static_cast<uint8_t*>(buffer));
+	}
+	results.assign(depth, 0);
+	ready.assign(depth, false);
+
+	if (!setupRing()) { release(); return; }
+	for (uint64_t block = 0; block < std::min<uint64_t>(depth, totalBlocks); ++block) queueRead(block);
+
+	//Global header, anything but classic pcap is left to libpcap
+	uint8_t globalHeader[Pcap_Global_Header_Length];
+	if (!copyBytes(globalHeader, sizeof(globalHeader))) { release(); return; }
+
+	if (!PcapFormat::readFileHeader(globalHeader, format)) { release(); return; }
+	valid = true;
+#endif
+}
+
+UringReader::~UringReader() { release(); }
+
+bool UringReader::isValid() const { return valid; }
+
+UringReader::Status UringReader::getNextPacket() {
+	if (!valid) return Status::Error;
+
+	uint8_t recordHeader[Pcap_Record_Header_Length];
+	recordOffset = curBlock * blockSize + curPos;
+	if (!copyBytes(recordHeader, sizeof(recordHeader))) return readError ? Status::Error : Status::Eof;
+
+	PcapFormat::toPkthdr(PcapFormat::readRecordHeader(recordHeader, format.swapped), format.nanoseconds, pkt_header); //Match libpcap, microseconds
+	if (pkt_header.caplen > Pcap_Max_Record_Length) return Status::Error;
+
+	//Whole record in current block, hand out a pointer into it
+	if (curLen - curPos >= pkt_header.caplen) {
+		pkt_data = curData + curPos;
+		curPos += pkt_header.caplen;
+		return Status::Packet;
+	}
+
+	//Straddles a block boundary, stitch into carry
+	carry.resize(pkt_header.caplen);
+	if (!copyBytes(carry.data(), carry.size())) return readError ? Status::Error : Status::Eof;
+	pkt_data = carry.data();
+	return Status::Packet;
+}
+
+pcap_pkthdr* UringReader::getHeader() { return &pkt_header; }
+
+const u_char* UringReader::getData() const { return pkt_data; }
+
+uint64_t UringReader::getRecordOffset() const { return recordOffset; }
+
+bool UringReader::copyBytes(uint8_t* dst, size_t length) {
+	while (length) {
+		if (curPos == curLen && !nextBlock()) return false;
+		size_t chunk = std::min<size_t>(length, curLen - curPos);
+		std::memcpy(dst, curData + curPos, chunk);
+		dst += chunk;
+		curPos += chunk;
+		length -= chunk;
+	}
+	return true;
+}
+
+bool UringReader::nextBlock() {
+#ifdef FLOW_HAVE_URING
+	if (curBlock >= totalBlocks) return false;
+
+	//Done with current block, its slot reads ahead depth blocks
+	if (curData) {
+		if (curBlock + depth < totalBlocks) queueRead(curBlock + depth);
+		++curBlock;
+		curData = nullptr;
+		curLen = curPos = 0;
+		if (curBlock >= totalBlocks) return false;
+	}
+
+	if (!waitBlock(curBlock)) {
+		readError = true;
+		return false;
+	}
+	curData = buffers[curBlock % depth];
+	curLen = (size_t)std::min<uint64_t>(blockSize, fileSize - curBlock * blockSize);
+	curPos = 0;
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef FLOW_HAVE_URING
+bool UringReader::setupRing() {
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	if ((ringFd = (int)syscall(__NR_io_uring_setup, depth, &params)) < 0) return false;
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMmap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+	sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (sqRing == MAP_FAILED) { sqRing = nullptr; return false; }
+	if (singleMmap)
+		cqRing = sqRing;
+	else {
+		cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (cqRing == MAP_FAILED) { cqRing = nullptr; return false; }
+	}
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	void* sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (sqeMap == MAP_FAILED) return false;
+	sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+	uint8_t* sq = static_cast<uint8_t*>(sqRing);
+	uint8_t* cq = static_cast<uint8_t*>(cqRing);
+	sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+	cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	//Registered buffers skip per-read page pinning, plain reads if memlock limit says no
+	std::vector<iovec> iovecs(depth);
+	for (unsigned i = 0; i < depth; ++i) iovecs[i] = { buffers[i], blockSize };
+	fixedBuffers = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, iovecs.data(), depth) == 0;
+
+	return true;
+}
+
+void UringReader::queueRead(uint64_t block) {
+	unsigned slot = (unsigned)(block % depth);
+	unsigned tail = *sqTail;
+	unsigned index = tail & *sqMask;
+
+	io_uring_sqe& sqe = sqes[index];
+	std::memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe.fd = fd;
+	sqe.off = block * blockSize;
+	sqe.addr = reinterpret_cast<uint64_t>(buffers[slot]);
+	sqe.len = (uint32_t)blockSize;
+	sqe.buf_index = fixedBuffers ? (uint16_t)slot : 0;
+	sqe.user_data = slot;
+
+	sqArray[index] = index;
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	ready[slot] = false;
+	++pendingSubmit;
+	++inFlight;
+}
+
+bool UringReader::waitBlock(uint64_t block) {
+	unsigned slot = (unsigned)(block % depth);
+
+	while (true) {
+		//Reap whatever completed
+		unsigned head = *cqHead;
+		unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; ++head) {
+			const io_uring_cqe& cqe = cqes[head & *cqMask];
+			results[cqe.user_data] = cqe.res;
+			ready[cqe.user_data] = true;
+			--inFlight;
+		}
+		__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+		if (ready[slot] && pendingSubmit == 0) break;
+
+		//Submit queued reads, block only if our block isn't back yet
+		unsigned minComplete = ready[slot] ? 0 : 1;
+		int ret = (int)syscall(__NR_io_uring_enter, ringFd, pendingSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (ret < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		pendingSubmit -= std::min<unsigned>(pendingSubmit, (unsigned)ret);
+	}
+
+	uint64_t expected = std::min<uint64_t>(blockSize, fileSize - block * blockSize);
+	return results[slot] >= 0 && (uint64_t)results[slot] >= expected;
+}
+#endif
+
+void UringReader::release() {
+#ifdef FLOW_HAVE_URING
+	//Kernel may still be writing into buffers, drain before freeing them
+	if (ringFd >= 0 && cqHead) {
+		while (inFlight > 0 || pendingSubmit > 0) {
+			int ret = (int)syscall(__NR_io_uring_enter, ringFd, pendingSubmit, inFlight ? 1 : 0, inFlight ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+			if (ret < 0 && errno != EINTR) break;
+			if (ret > 0) pendingSubmit -= std::min<unsigned>(pendingSubmit, (unsigned)ret);
+
+			unsigned head = *cqHead;
+			unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head) --inFlight;
+			__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+		}
+	}
+
+	if (sqes) munmap(sqes, sqesSize);
+	if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+	if (sqRing) munmap(sqRing, sqRingSize);
+	if (ringFd >= 0) close(ringFd);
+	if (fd >= 0) close(fd);
+	sqes = nullptr;
+	sqRing = cqRing = nullptr;
+	cqHead = nullptr;
+	ringFd = fd = -1;
+#endif
+	for (uint8_t* buffer : buffers) std::free(buffer);
+	buffers.clear();
+	valid = false;
+}
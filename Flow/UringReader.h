@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <pcap.h>
+#include "PcapFormat.h"
+
+#define Uring_Default_Queue_Depth 8
+#define Uring_Default_Block_Size (1 << 20)
+#define Uring_Block_Alignment 4096
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define FLOW_HAVE_URING 1
+#endif
+
+/*
+Classic pcap reader backed by io_uring (Linux only)
+-File opened with O_DIRECT, read in large aligned blocks into registered buffers
+-queueDepth block reads kept in flight, records parsed straight out of the blocks
+-Records straddling a block boundary are stitched together in a carry buffer
+-Anything unsupported (no io_uring, pcapng, ...) leaves the reader invalid,
+ callers fall back to libpcap
+*/
+class UringReader {
+public:
+	enum class Status { Packet, Eof, Error };
+
+	/*
+	Open a pcap file and start reading ahead
+	Inputs:
+			filename	-pcap file path
+			queueDepth	-Number of block reads in flight
+			blockSize	-Bytes per read, multiple of Uring_Block_Alignment
+	*/
+	UringReader(const char* filename, unsigned queueDepth = Uring_Default_Queue_Depth, size_t blockSize = Uring_Default_Block_Size);
+	~UringReader();
+	UringReader(const UringReader&) = delete; //We own the ring, fd and buffers
+	UringReader& operator=(const UringReader&) = delete;
+
+	bool isValid() const;
+
+	/*
+	Fetch the next record
+	Header/data stay valid until the next call
+	Outputs:
+			Status	-Packet, Eof or Error
+	*/
+	Status getNextPacket();
+	pcap_pkthdr* getHeader();
+	const u_char* getData() const;
+	uint64_t getRecordOffset() const; //File offset of current record header
+
+private:
+	bool valid = false;
+	pcap_pkthdr pkt_header{};
+	const u_char* pkt_data = nullptr;
+	PcapFormat::FileHeader format;
+
+	int fd = -1;
+	uint64_t fileSize = 0;
+	size_t blockSize = 0;
+	unsigned depth = 0;
+
+	//One slot per in-flight read
+	std::vector<uint8_t*> buffers;
+	std::vector<int> results;
+	std::vector<bool> ready;
+	bool fixedBuffers = false;	//Buffers registered with the ring
+
+	uint64_t totalBlocks = 0;
+	uint64_t curBlock = 0;		//Block being parsed
+	const uint8_t* curData = nullptr;
+	size_t curLen = 0;
+	size_t curPos = 0;
+	std::vector<uint8_t> carry;
+	bool readError = false;
+	uint64_t recordOffset = 0;
+
+#ifdef FLOW_HAVE_URING
+	int ringFd = -1;
+	void* sqRing = nullptr;
+	void* cqRing = nullptr;
+	size_t sqRingSize = 0;
+	size_t cqRingSize = 0;
+	struct io_uring_sqe* sqes = nullptr;
+	size_t sqesSize = 0;
+	unsigned* sqHead = nullptr;
+	unsigned* sqTail = nullptr;
+	unsigned* sqMask = nullptr;
+	unsigned* sqArray = nullptr;
+	unsigned* cqHead = nullptr;
+	unsigned* cqTail = nullptr;
+	unsigned* cqMask = nullptr;
+	struct io_uring_cqe* cqes = nullptr;
+	unsigned pendingSubmit = 0;	//Queued, not yet handed to kernel
+	unsigned inFlight = 0;		//Queued, not yet completed
+
+	/*
+	Helper functions
+	Ring setup, queue a block read, wait for a block
+	Outputs:
+			true/false	-True if success
+	*/
+	bool setupRing();
+	void queueRead(uint64_t block);
+	bool waitBlock(uint64_t block);
+#endif
+
+	/*
+	Helper functions
+	Move to next block when current one is used up, copy bytes across blocks
+	Outputs:
+			true/false	-False at end of file or on read error
+	*/
+	bool nextBlock();
+	bool copyBytes(uint8_t* dst, size_t length);
+
+	void release();
+};
@@ -1,15 +1,30 @@
 #include <stdio.h>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <filesystem>
 #include <pcap.h>
 #include "Stats.h"
+#include "ApproxStats.h"
+#include "StatsMonitor.h"
+#include "SliceIndex.h"
 #include "PcapHandler.h"
 #include "PacketParser.h"
+#include "PacketFilter.h"
 #include "TestCases.cpp"
 
 void usage(const char* progName) {
-	printf("usage: %s <directory>", progName);
+	printf("usage: %s <directory>\n", progName);
+	printf("       %s --index <directory>\n", progName);
+	printf("       %s --snapshot <directory> <output.snap>\n", progName);
+	printf("       %s --merge <snapshot> [<snapshot>...]\n", progName);
+	printf("       %s --approx <sample rate> <directory>\n", progName);
+	printf("       %s --publish <segment> <directory>\n", progName);
+	printf("       %s --monitor <segment> [--prometheus]\n", progName);
+	printf("       %s --extract <directory> <output.pcap> <seq|time> <from> <to> [A|B|both]", progName);
 }
 
 /*
@@ -40,6 +55,53 @@ std::pair<bool, std::vector<std::string>> findPcapFiles(const std::string& dirPa
 	return { true, ret };
 }
 
+/*
+	Parse every packet of every file into stats
+	Inputs:
+			fileList	-pcap files to read
+			parser		-Parser, keeps decode counters across files
+			stats		-Stats or ApproxStats to add packets to
+			publisher	-Optional live shared memory publisher (Stats only)
+			buildIndex	-Also save a <file>.idx slice index next to each capture (--index)
+	Frames that can't be A/B packets are dropped by the pre-parse filter
+	*/
+template <typename StatsType>
+void ingestFiles(const std::vector<std::string>& fileList, PacketParser& parser, StatsType& stats, StatsPublisher* publisher = nullptr, bool buildIndex = false) {
+	static const PacketFilter filter = PacketFilter::forSides();
+	parser.setFilter(&filter);
+
+	for (const std::string& file : fileList) {
+		PcapHandler channel(file.c_str());
+		if (!channel.isValid()){
+			std::cerr << "Couldn't load " << file << std::endl;
+			continue;
+		}
+		
+		SliceIndex index;
+		while (channel.getNextPacket() == PcapHandler::NextResult::Success) {
+			if (buildIndex) index.addRecord(channel.getRecordOffset());
+			if (parser.parseBytes(channel.getHeader(), channel.getData())) {
+				std::optional<Stats::Side> curSide = Stats::toSide(parser.getPort());
+				if (curSide) {
+					stats.add(*curSide, parser.getSequence(), parser.getTimestamp());
+					if constexpr (std::is_same_v<StatsType, ApproxStats>) parser.setSampleRate(stats.getSampleRate());
+					if (buildIndex) index.addPacket(parser.getSequence(), parser.getTimestamp());
+				}
+			}
+			if constexpr (std::is_same_v<StatsType, Stats>) {
+				if (publisher) publisher->tick(stats, parser);
+			}
+		}
+
+		//Best effort, the analysis goes on and --extract rebuilds it on demand
+		if (buildIndex && index.isValid()) {
+			std::error_code error;
+			index.finish(std::filesystem::file_size(file, error));
+			if (error || !index.save(SliceIndex::indexPath(file))) std::cerr << "Unable to save slice index for " << file << std::endl;
+		}
+	}
+}
+
 int main(int argc, char** argv)
 {
 	//TEST CASES
@@ -47,13 +109,163 @@ int main(int argc, char** argv)
 	//t.runAll();
 	//return 0;
 
-	if (argc != 2){
+	//Shard: any subset of files, write partial state for a later merge
+	if (argc == 4 && std::string(argv[1]) == "--snapshot") {
+		auto [success, fileList] = findPcapFiles(argv[2]);
+		if (!success) return 1;
+
+		PacketParser parser;
+		Stats stats;
+		ingestFiles(fileList, parser, stats);
+		if (!stats.saveSnapshot(argv[3], &parser.getCounters())) return 1;
+
+		parser.printCounters();
+		return 0;
+	}
+
+	//Reduce: combine shard snapshots into the final report
+	if (argc >= 3 && std::string(argv[1]) == "--merge") {
+		Stats stats;
+		PacketParser::DecodeCounters counters;
+		for (int i = 2; i < argc; ++i)
+			if (!stats.mergeSnapshot(argv[i], &counters)) return 1;
+
+		//Shards ran with the pre-parse filter, report it like a single run does
+		static const PacketFilter filter = PacketFilter::forSides();
+		PacketParser parser;
+		parser.setFilter(&filter);
+		parser.addCounters(counters);
+
+		stats.generateStats();
+		std::cout << std::endl;
+		parser.printCounters();
+		return 0;
+	}
+
+	//Fast look: sketches + 1/N seq sample capped at Approx_Max_Sampled_Seqs, bounded memory
+	if (argc == 4 && std::string(argv[1]) == "--approx") {
+		uint32_t sampleRate = (uint32_t)std::strtoul(argv[2], nullptr, 10);
+		if (sampleRate == 0) {
+			usage(argv[0]);
+			return 1;
+		}
+		auto [success, fileList] = findPcapFiles(argv[3]);
+		if (!success) return 1;
+
+		PacketParser parser;
+		parser.setSampleRate(sampleRate);
+		ApproxStats stats(sampleRate);
+		ingestFiles(fileList, parser, stats);
+
+		stats.generateStats();
+		std::cout << std::endl;
+		parser.printCounters();
+		return 0;
+	}
+
+	//Live reader for a --publish run, never blocks the writer
+	if ((argc == 3 || argc == 4) && std::string(argv[1]) == "--monitor") {
+		bool prometheus = (argc == 4 && std::string(argv[3]) == "--prometheus");
+		if (argc == 4 && !prometheus) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		StatsMonitor monitor(argv[2]);
+		MonitorPayload payload;
+		if (!monitor.isValid() || !monitor.read(payload)) {
+			std::cerr << "No live stats segment: " << argv[2] << std::endl;
+			return 1;
+		}
+		if (prometheus) {
+			monitor.renderPrometheus(payload);
+			return 0;
+		}
+
+		//Writer killed or hung leaves the last snapshot behind, don't render it forever
+		uint64_t lastPublish = payload.publishCount;
+		auto lastProgress = std::chrono::steady_clock::now();
+		while (true) {
+			monitor.render(payload);
+			if (payload.finished) break;
+			std::cout << std::endl;
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+			if (!monitor.read(payload)) {
+				std::cerr << "Live stats writer stopped mid-publish: " << argv[2] << std::endl;
+				return 1;
+			}
+
+			auto now = std::chrono::steady_clock::now();
+			if (payload.publishCount != lastPublish) {
+				lastPublish = payload.publishCount;
+				lastProgress = now;
+			}
+			else if (now - lastProgress > std::chrono::seconds(Monitor_Stall_Timeout_s)) {
+				std::cerr << "No live stats published for " << Monitor_Stall_Timeout_s << "s, writer stalled or gone: " << argv[2] << std::endl;
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	//Pull a seq or time range back out as a pcap, via each capture's slice index
+	if ((argc == 7 || argc == 8) && std::string(argv[1]) == "--extract") {
+		SliceIndex::Query query;
+		std::string key = argv[4];
+		std::string side = (argc == 8) ? argv[7] : "both";
+		if ((key != "seq" && key != "time") || (side != "A" && side != "B" && side != "both")) {
+			usage(argv[0]);
+			return 1;
+		}
+		query.key = (key == "seq") ? SliceIndex::Key::Seq : SliceIndex::Key::Time;
+		query.from = std::strtoull(argv[5], nullptr, 10);
+		query.to = std::strtoull(argv[6], nullptr, 10);
+		if (side != "both") query.side = (side == "A") ? Stats::Side::A : Stats::Side::B;
+
+		auto [success, fileList] = findPcapFiles(argv[2]);
+		if (!success) return 1;
+
+		std::ofstream out(argv[3], std::ios::binary | std::ios::trunc);
+		if (!out) {
+			std::cerr << "Unable to open output file: " << argv[3] << std::endl;
+			return 1;
+		}
+
+		size_t total = 0;
+		SliceIndex::OutputFormat format;
+		for (const std::string& file : fileList) {
+			SliceIndex index;
+			std::error_code error;
+			uint64_t fileSize = std::filesystem::file_size(file, error);
+			if (error || !index.load(SliceIndex::indexPath(file), fileSize)) {
+				if (!index.build(file)) {
+					std::cerr << "Unable to index " << file << std::endl;
+					continue;
+				}
+				index.save(SliceIndex::indexPath(file));
+			}
+
+			std::optional<size_t> written = index.extract(file, query, out, format);
+			if (!written) {
+				std::cerr << "Error extracting from " << file << std::endl;
+				return 1;
+			}
+			total += *written;
+		}
+
+		std::cout << "Extracted " << total << " packets to " << argv[3] << std::endl;
+		return 0;
+	}
+
+	bool publish = (argc == 4 && std::string(argv[1]) == "--publish");
+	bool buildIndex = (argc == 3 && std::string(argv[1]) == "--index");
+	if (argc != 2 && !publish && !buildIndex){
 		usage(argv[0]);
 		return 1;
 	}
 
 	//Find all pcap files
-	auto [success, fileList] = findPcapFiles(argv[1]);
+	auto [success, fileList] = findPcapFiles(argv[argc - 1]);
 	if (!success) return 1;
 
 	if (fileList.size() != 2) {
@@ -64,22 +276,18 @@ int main(int argc, char** argv)
 	//Parse packets and log
 	PacketParser parser;
 	Stats stats;
-	for (std::string& file : fileList) {
-		PcapHandler channel(file.c_str());
-		if (!channel.isValid()){
-			std::cerr << "Couldn't load " << file << std::endl;
-			continue;
-		}
-		
-		while (channel.getNextPacket() == PcapHandler::NextResult::Success) {
-			if (parser.parseBytes(channel.getHeader(), channel.getData())) {
-				std::optional<Stats::Side> curSide = Stats::toSide(parser.getPort());
-				if(curSide) stats.add(*curSide, parser.getSequence(), parser.getTimestamp());
-			}
-		}
+	std::unique_ptr<StatsPublisher> publisher;
+	if (publish) {
+		publisher = std::make_unique<StatsPublisher>(argv[2]);
+		if (!publisher->isValid()) std::cerr << "Unable to create live stats segment: " << argv[2] << std::endl;
+		stats.enableLiveCounters();
 	}
+	ingestFiles(fileList, parser, stats, publisher.get(), buildIndex);
+	if (publisher) publisher->publish(stats, parser.getCounters(), true);
 
 	stats.generateStats();
+	std::cout << std::endl;
+	parser.printCounters();
 
 	return 0;
 }
@@ -88,12 +296,9 @@ int main(int argc, char** argv)
 //TODO: Properly parse/view all fields instead of skipping/jumping
 //TODO: get each view
 //TODO: Make headers optional, they might be missing
-//TODO: Dont assume EtherType (Could be length)
 //TODO: Dont assume windows i.e. winsock2.h
 //TODO: Save pointer to data instead of copy
 //TODO: Walk trailer backwards per spec
 //TODO: instead of assume/hardcode side A and B, segregate by  channel port
 //TODO: Edge handling for malformed or truncated packets
-//TODO: Error logging (count parse drops)
-//TODO: More robust test cases
-//TODO: check for udp before assuming, for ipv4 before assuming, etc
\ No newline at end of file
+//TODO: More robust test cases
\ No newline at end of file